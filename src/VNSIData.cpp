@@ -20,11 +20,15 @@
  */
 
 #include "VNSIData.h"
+#include "VNSIDemux.h"
+#include "VNSIRecording.h"
 #include "responsepacket.h"
 #include "requestpacket.h"
 #include "vnsicommand.h"
 #include <p8-platform/util/StringUtils.h>
+#include <p8-platform/util/timeutils.h>
 #include <algorithm>
+#include <thread>
 #include <string.h>
 #include <time.h>
 
@@ -65,32 +69,6 @@ time_t SetTime(time_t t, int secondsFromMidnight)
 using namespace ADDON;
 using namespace P8PLATFORM;
 
-cVNSIData::SMessage &
-cVNSIData::Queue::Enqueue(uint32_t serial)
-{
-  const CLockObject lock(m_mutex);
-  return m_queue[serial];
-}
-
-std::unique_ptr<cResponsePacket>
-cVNSIData::Queue::Dequeue(uint32_t serial, SMessage &message)
-{
-  const CLockObject lock(m_mutex);
-  auto vresp = std::move(message.pkt);
-  m_queue.erase(serial);
-  return vresp;
-}
-
-void cVNSIData::Queue::Set(std::unique_ptr<cResponsePacket> &&vresp)
-{
-  CLockObject lock(m_mutex);
-  SMessages::iterator it = m_queue.find(vresp->getRequestID());
-  if (it != m_queue.end()) {
-    it->second.pkt = std::move(vresp);
-    it->second.event.Broadcast();
-  }
-}
-
 cVNSIData::cVNSIData()
 {
 }
@@ -127,6 +105,8 @@ void cVNSIData::OnDisconnect()
 
 void cVNSIData::OnReconnect()
 {
+  // the server may have been restarted with a different setup
+  cVNSIDemux::ResetServerSetup();
   EnableStatusInterface(true, false);
 
   PVR->ConnectionStateChange("vnsi connection established", PVR_CONNECTION_STATE_CONNECTED, XBMC->GetLocalizedString(30045));
@@ -138,15 +118,73 @@ void cVNSIData::OnReconnect()
 
 std::unique_ptr<cResponsePacket> cVNSIData::ReadResult(cRequestPacket* vrp)
 {
-  SMessage &message = m_queue.Enqueue(vrp->getSerial());
+  SMessage *message = ClaimSlot(vrp->getSerial());
+  if (!message)
+    return nullptr;
 
   if (cVNSISession::TransmitMessage(vrp) &&
-      !message.event.Wait(g_iConnectTimeout * 1000))
+      !message->event.Wait(g_iConnectTimeout * 1000))
   {
     XBMC->Log(LOG_ERROR, "%s - request timed out after %d seconds", __FUNCTION__, g_iConnectTimeout);
   }
 
-  return m_queue.Dequeue(vrp->getSerial(), message);
+  return m_queue.Dequeue(message);
+}
+
+std::vector<std::unique_ptr<cResponsePacket>> cVNSIData::ReadResults(const std::vector<cRequestPacket*> &vrps)
+{
+  // requests without a slot are not sent, their reply would be dropped
+  std::vector<SMessage*> messages;
+  std::vector<cRequestPacket*> sending;
+  messages.reserve(vrps.size());
+  sending.reserve(vrps.size());
+  for (auto vrp : vrps)
+  {
+    SMessage *message = ClaimSlot(vrp->getSerial());
+    messages.push_back(message);
+    if (message)
+      sending.push_back(vrp);
+  }
+
+  if (!sending.empty() && cVNSISession::TransmitMessages(sending.data(), sending.size()))
+  {
+    // one deadline for the whole batch, the replies arrive back to back
+    int64_t target = GetTimeMs() + g_iConnectTimeout * 1000;
+    for (auto message : messages)
+    {
+      if (!message)
+        continue;
+
+      int64_t remaining = target - GetTimeMs();
+      if (remaining <= 0 || !message->event.Wait((uint32_t)remaining))
+      {
+        XBMC->Log(LOG_ERROR, "%s - request timed out after %d seconds", __FUNCTION__, g_iConnectTimeout);
+        break;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<cResponsePacket>> results;
+  results.reserve(vrps.size());
+  for (size_t i = 0; i < vrps.size(); i++)
+    results.push_back(m_queue.Dequeue(messages[i]));
+
+  return results;
+}
+
+cVNSIData::SMessage *cVNSIData::ClaimSlot(uint32_t serial)
+{
+  SMessage *message = m_queue.Enqueue(serial);
+  if (message)
+    return message;
+
+  // all slots taken by requests the server has not answered yet, one of
+  // them gets its reply or times out eventually
+  XBMC->Log(LOG_INFO, "%s - all %d response slots in use, waiting", __FUNCTION__, (int)Queue::kSlots);
+  message = m_queue.Enqueue(serial, g_iConnectTimeout * 1000);
+  if (!message)
+    XBMC->Log(LOG_ERROR, "%s - no response slot, request not sent", __FUNCTION__);
+  return message;
 }
 
 bool cVNSIData::GetDriveSpace(long long *total, long long *used)
@@ -175,42 +213,35 @@ bool cVNSIData::GetDriveSpace(long long *total, long long *used)
   return true;
 }
 
-bool cVNSIData::SupportChannelScan()
+void cVNSIData::GetSupportedFeatures(bool &channelScan, bool &recordingsUndelete)
 {
-  cRequestPacket vrp;
-  vrp.init(VNSI_SCAN_SUPPORTED);
+  channelScan = false;
+  recordingsUndelete = false;
 
-  auto vresp = ReadResult(&vrp);
-  if (!vresp)
-  {
-    XBMC->Log(LOG_ERROR, "%s - Can't get response packed", __FUNCTION__);
-    return false;
-  }
+  cRequestPacket vrpScan;
+  vrpScan.init(VNSI_SCAN_SUPPORTED);
 
-  uint32_t ret = vresp->extract_U32();
-  return ret == VNSI_RET_OK ? true : false;
-}
+  cRequestPacket vrpUndelete;
 
-bool cVNSIData::SupportRecordingsUndelete()
-{
+  std::vector<cRequestPacket*> vrps;
+  vrps.push_back(&vrpScan);
   if (GetProtocol() > 7)
   {
-    cRequestPacket vrp;
-    vrp.init(VNSI_RECORDINGS_DELETED_ACCESS_SUPPORTED);
+    vrpUndelete.init(VNSI_RECORDINGS_DELETED_ACCESS_SUPPORTED);
+    vrps.push_back(&vrpUndelete);
+  }
+  else
+    XBMC->Log(LOG_INFO, "%s - Undelete not supported on backend (min. Ver. 1.3.0; Protocol 7)", __FUNCTION__);
 
-    auto vresp = ReadResult(&vrp);
-    if (!vresp)
-    {
-      XBMC->Log(LOG_INFO, "%s - Can't get response packed", __FUNCTION__);
-      return false;
-    }
+  auto vresps = ReadResults(vrps);
 
-    uint32_t ret = vresp->extract_U32();
-    return ret == VNSI_RET_OK ? true : false;
-  }
+  if (vresps[0])
+    channelScan = vresps[0]->extract_U32() == VNSI_RET_OK;
+  else
+    XBMC->Log(LOG_ERROR, "%s - Can't get response packed", __FUNCTION__);
 
-  XBMC->Log(LOG_INFO, "%s - Undelete not supported on backend (min. Ver. 1.3.0; Protocol 7)", __FUNCTION__);
-  return false;
+  if (vresps.size() > 1 && vresps[1])
+    recordingsUndelete = vresps[1]->extract_U32() == VNSI_RET_OK;
 }
 
 bool cVNSIData::EnableStatusInterface(bool onOff, bool wait)
@@ -1207,17 +1238,15 @@ void *cVNSIData::Process()
       }
     }
 
-    // if there's anything in the buffer, read it
-    if ((vresp = cVNSISession::ReadMessage(5, 10000)) == NULL)
-    {
-      Sleep(5);
+    // block until the next message arrives, Close() wakes us up early
+    if ((vresp = cVNSISession::ReadMessage(1000, 10000)) == NULL)
       continue;
-    }
 
     // CHANNEL_REQUEST_RESPONSE
     if (vresp->getChannelID() == VNSI_CHANNEL_REQUEST_RESPONSE)
     {
-      m_queue.Set(std::move(vresp));
+      uint32_t serial = vresp->getRequestID();
+      m_queue.Set(serial, std::move(vresp));
     }
 
     // CHANNEL_STATUS
@@ -1268,6 +1297,7 @@ void *cVNSIData::Process()
       else if (vresp->getRequestID() == VNSI_STATUS_RECORDINGSCHANGE)
       {
         XBMC->Log(LOG_DEBUG, "Server requested recordings update");
+        cVNSIRecording::RecordingsChanged();
         PVR->TriggerRecordingUpdate();
       }
       else if (vresp->getRequestID() == VNSI_STATUS_EPGCHANGE)
@@ -1305,8 +1335,11 @@ int cVNSIData::GetChannelGroupCount(bool automatic)
   return count;
 }
 
-bool cVNSIData::GetChannelGroupList(ADDON_HANDLE handle, bool bRadio)
+bool cVNSIData::GetChannelGroupList(ADDON_HANDLE handle, bool bRadio, bool automatic)
 {
+  if (GetChannelGroupCount(automatic) == 0)
+    return true;
+
   cRequestPacket vrp;
   vrp.init(VNSI_CHANNELGROUP_LIST);
   vrp.add_U8(bRadio);
@@ -1317,6 +1350,12 @@ bool cVNSIData::GetChannelGroupList(ADDON_HANDLE handle, bool bRadio)
     return false;
   }
 
+  TransferChannelGroups(handle, vresp.get());
+  return true;
+}
+
+void cVNSIData::TransferChannelGroups(ADDON_HANDLE handle, cResponsePacket *vresp)
+{
   while (vresp->getRemainingLength() >= 1 + 1)
   {
     PVR_CHANNEL_GROUP tag;
@@ -1329,8 +1368,6 @@ bool cVNSIData::GetChannelGroupList(ADDON_HANDLE handle, bool bRadio)
 
     PVR->TransferChannelGroup(handle, &tag);
   }
-
-  return true;
 }
 
 bool cVNSIData::GetChannelGroupMembers(ADDON_HANDLE handle, const PVR_CHANNEL_GROUP &group)
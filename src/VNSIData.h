@@ -22,9 +22,12 @@
 
 #include "VNSISession.h"
 #include "client.h"
+#include "slottable.h"
 
+#include <atomic>
 #include <string>
 #include <map>
+#include <vector>
 
 class cResponsePacket;
 class cRequestPacket;
@@ -37,8 +40,7 @@ public:
   virtual ~cVNSIData();
 
   bool Start(const std::string& hostname, int port, const char* name = NULL, const std::string& mac = "");
-  bool        SupportChannelScan();
-  bool        SupportRecordingsUndelete();
+  void        GetSupportedFeatures(bool &channelScan, bool &recordingsUndelete);
   bool        EnableStatusInterface(bool onOff, bool wait = true);
   bool        GetDriveSpace(long long *total, long long *used);
 
@@ -47,7 +49,7 @@ public:
   bool        GetEPGForChannel(ADDON_HANDLE handle, const PVR_CHANNEL &channel, time_t start, time_t end);
 
   int         GetChannelGroupCount(bool automatic);
-  bool        GetChannelGroupList(ADDON_HANDLE handle, bool bRadio);
+  bool        GetChannelGroupList(ADDON_HANDLE handle, bool bRadio, bool automatic);
   bool        GetChannelGroupMembers(ADDON_HANDLE handle, const PVR_CHANNEL_GROUP &group);
 
   bool        GetTimersList(ADDON_HANDLE handle);
@@ -72,7 +74,14 @@ public:
   PVR_ERROR   DeleteAllRecordingsFromTrash();
   PVR_ERROR   UndeleteAllRecordingsFromTrash();
 
-  std::unique_ptr<cResponsePacket> ReadResult(cRequestPacket* vrp);
+  std::unique_ptr<cResponsePacket> ReadResult(cRequestPacket* vrp) override;
+
+  /*!
+   * Pipelined variant of ReadResult: all requests go out with one write,
+   * then the replies are collected. Results are in request order, a request
+   * without reply gets nullptr.
+   */
+  std::vector<std::unique_ptr<cResponsePacket>> ReadResults(const std::vector<cRequestPacket*> &vrps);
 
 protected:
 
@@ -84,23 +93,12 @@ protected:
 
 private:
 
-  struct SMessage
-  {
-    P8PLATFORM::CEvent event;
-    std::unique_ptr<cResponsePacket> pkt;
-  };
-
-  class Queue {
-    typedef std::map<int, SMessage> SMessages;
-    SMessages m_queue;
-    P8PLATFORM::CMutex m_mutex;
-
-  public:
-    SMessage &Enqueue(uint32_t serial);
-    std::unique_ptr<cResponsePacket> Dequeue(uint32_t serial,
-                                             SMessage &message);
-    void Set(std::unique_ptr<cResponsePacket> &&vresp);
-  };
+  void TransferChannelGroups(ADDON_HANDLE handle, cResponsePacket *vresp);
+
+  typedef cSlotTable<cResponsePacket> Queue;
+  typedef Queue::SSlot SMessage;
+
+  SMessage *ClaimSlot(uint32_t serial);
 
   Queue m_queue;
 
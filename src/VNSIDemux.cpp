@@ -23,16 +23,32 @@
 #include <limits.h>
 #include <string.h>
 #include <time.h>
+#include <algorithm>
 #include "VNSIDemux.h"
+#include "VNSIZapper.h"
+#include "namecache.h"
 #include "responsepacket.h"
 #include "requestpacket.h"
 #include "vnsicommand.h"
 #include "tools.h"
+#include "p8-platform/util/timeutils.h"
 
 using namespace ADDON;
+using namespace P8PLATFORM;
+
+// server timestamps are integer microseconds, they are only converted
+// where they are handed to Kodi
+std::atomic<int> cVNSIDemux::s_timeshiftSetup(-1);
+
+static inline int64_t ToDVDTime(int64_t us)
+{
+  return DVD_TIME_BASE == 1000000 ? us : us * DVD_TIME_BASE / 1000000;
+}
 
 cVNSIDemux::cVNSIDemux()
 {
+  SetSocketProfile(cVNSISocket::PROFILE_STREAM);
+  BuildStreamIndex();
 }
 
 cVNSIDemux::~cVNSIDemux()
@@ -42,6 +58,19 @@ cVNSIDemux::~cVNSIDemux()
 
 void cVNSIDemux::Close()
 {
+  m_statusCon.Stop();
+  StopPrefetch();
+  ClearBatch();
+
+  if (m_liveBuffer.IsEnabled())
+  {
+    cLiveBuffer::SStats stats = m_liveBuffer.GetStats();
+    XBMC->Log(LOG_DEBUG, "%s - live buffer: %llu seeks served locally, %llu from server, %d of %d MiB used (%s)", __FUNCTION__,
+              (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+              (int)(stats.bytes >> 20), (int)(stats.capacity >> 20), stats.file ? "file" : "memory");
+    m_liveBuffer.Clear();
+  }
+
   if (IsOpen() && GetProtocol() >= 9)
   {
     XBMC->Log(LOG_DEBUG, "closing demuxer");
@@ -63,59 +92,246 @@ void cVNSIDemux::Close()
   cVNSISession::Close();
 }
 
+bool cVNSIDemux::Connect()
+{
+  if(!cVNSISession::Open(g_szHostname, g_iPort))
+    return false;
+
+  if (!cVNSISession::Login())
+    return false;
+
+  // the status connection comes up in the background, SwitchChannel()
+  // picks it up once the open request is out
+  if (GetProtocol() >= 13)
+    m_statusCon.PrepareAsync();
+
+  return true;
+}
+
 bool cVNSIDemux::OpenChannel(const PVR_CHANNEL &channelinfo)
 {
   m_channelinfo = channelinfo;
-  if(!cVNSISession::Open(g_szHostname, g_iPort))
+
+  // standby sessions are connected already
+  if (!IsConnected() && !Connect())
     return false;
 
-  if(!cVNSISession::Login())
+  if (!SwitchChannel(m_channelinfo))
     return false;
 
-  return SwitchChannel(m_channelinfo);
+  if (!g_bLiveBuffer)
+    m_liveBuffer.SetStorage(0);
+  else if (!g_szLiveBufferDir.empty())
+    m_liveBuffer.SetStorage((size_t)g_iLiveBufferDiskMB * 1024 * 1024, g_szLiveBufferDir);
+  else
+    m_liveBuffer.SetStorage((size_t)g_iLiveBufferMB * 1024 * 1024);
+
+  if (g_bPrefetch)
+    StartPrefetch();
+
+  return true;
+}
+
+void cVNSIDemux::StartZapTimer(cVNSIZapper *zapper, int64_t start, bool warm)
+{
+  m_zapper = zapper;
+  m_zapStart = start;
+  m_zapWarm = warm;
 }
 
 bool cVNSIDemux::GetStreamProperties(PVR_STREAM_PROPERTIES* props)
 {
-  for (int i=0; i<m_streams.iStreamCount; i++)
+  const size_t max = sizeof(props->stream) / sizeof(props->stream[0]);
+  size_t count = std::min(m_streams.size(), max);
+
+  for (size_t i = 0; i < count; i++)
   {
-    memcpy(&props->stream[i], &m_streams.stream[i], sizeof(PVR_STREAM_PROPERTIES::PVR_STREAM));
+    const SStreamInfo &info = m_streams[i];
+    PVR_STREAM_PROPERTIES::PVR_STREAM &stream = props->stream[i];
+
+    memset(&stream, 0, sizeof(stream));
+    stream.iPID = info.iPID;
+    stream.iCodecType = info.iCodecType;
+    stream.iCodecId = info.iCodecId;
+    memcpy(stream.strLanguage, info.strLanguage, sizeof(stream.strLanguage));
+    stream.iSubtitleInfo = info.iSubtitleInfo;
+    stream.iFPSScale = info.iFPSScale;
+    stream.iFPSRate = info.iFPSRate;
+    stream.iHeight = info.iHeight;
+    stream.iWidth = info.iWidth;
+    stream.fAspect = info.fAspect;
+    stream.iChannels = info.iChannels;
+    stream.iSampleRate = info.iSampleRate;
+    stream.iBlockAlign = info.iBlockAlign;
+    stream.iBitRate = info.iBitRate;
+    stream.iBitsPerSample = info.iBitsPerSample;
   }
 
-  props->iStreamCount = m_streams.iStreamCount;
+  props->iStreamCount = count;
   return true;
 }
 
 void cVNSIDemux::Abort()
 {
-  m_streams.iStreamCount = 0;
+  ClearBatch();
+  m_streams.clear();
+  BuildStreamIndex();
 }
 
 DemuxPacket* cVNSIDemux::Read()
 {
+  // the receiver thread only flags a lost connection, the session is torn
+  // down here where nobody uses its packets anymore
+  if (m_receiverLost)
+    SignalConnectionLost();
+
   if (m_connectionLost)
   {
     return nullptr;
   }
 
-  ReadStatus();
+  if (m_batchCount > 0)
+  {
+    DemuxPacket* pkt = m_batch[m_batchHead];
+    m_batchHead = (m_batchHead + 1) % kBatchSize;
+    m_batchCount--;
+    return pkt;
+  }
+
+  // the receiver kept the live stream in the live buffer only while the
+  // queue was full, e.g. during a pause. Continue from there once the
+  // packets queued before are played
+  if (m_liveGap && m_prefetchQueue.Empty())
+  {
+    m_liveGap = false;
+    m_liveBuffer.Resume();
+  }
+
+  if (m_liveBuffer.IsReplaying())
+  {
+    DemuxPacket* pkt = ReadReplay();
+    if (pkt)
+      return pkt;
+  }
+
+  // consume control messages until there is something for the player,
+  // an empty packet is only returned once the deadline passed
+  int64_t deadline = GetTimeMs() + 1000;
+  int timeout;
+  while ((timeout = (int)(deadline - GetTimeMs())) > 0 && !m_connectionLost && !m_receiverLost)
+  {
+    DemuxPacket* pkt;
+    if (ReadPacket(timeout, pkt) && pkt)
+    {
+      if (pkt->iStreamId != DMX_SPECIALID_STREAMCHANGE)
+        DecodeAhead();
+      return pkt;
+    }
+  }
+
+  if (m_receiverLost)
+  {
+    SignalConnectionLost();
+    return nullptr;
+  }
+
+  return PVR->AllocateDemuxPacket(0);
+}
+
+void cVNSIDemux::DecodeAhead()
+{
+  // decode whatever has arrived already in one go, control messages take
+  // effect right away and media packets wait for the following Read() calls.
+  while (m_batchCount < kBatchSize && !m_connectionLost)
+  {
+    if (!MessageAvailable())
+      break;
+
+    DemuxPacket* pkt;
+    if (!ReadPacket(0, pkt))
+      break;
+    if (!pkt)
+      continue;
+
+    m_batch[(m_batchHead + m_batchCount) % kBatchSize] = pkt;
+    m_batchCount++;
+
+    // the stream table holds the new setup already, hand out the change
+    // before decoding more
+    if (pkt->iStreamId == DMX_SPECIALID_STREAMCHANGE)
+      break;
+  }
+}
+
+void cVNSIDemux::ClearBatch()
+{
+  while (m_batchCount > 0)
+  {
+    PVR->FreeDemuxPacket(m_batch[m_batchHead]);
+    m_batchHead = (m_batchHead + 1) % kBatchSize;
+    m_batchCount--;
+  }
+  m_batchHead = 0;
+}
+
+bool cVNSIDemux::MessageAvailable()
+{
+  // true if ReadPacket(0) finds a message without going to the socket
+  if (IsRunning())
+    return !m_prefetchQueue.Empty();
+  return GetBuffered() >= sizeof(uint32_t);
+}
+
+DemuxPacket* cVNSIDemux::ReadReplay()
+{
+  // keep up with the live stream meanwhile, ReadPacket() buffers it. Poll the
+  // socket once, after that only drain what has been received already
+  for (int i = 0; i < 64; i++)
+  {
+    if (i > 0 && !MessageAvailable())
+      break;
 
-  auto resp = ReadMessage(1000, g_iConnectTimeout * 1000);
+    DemuxPacket* pkt;
+    if (!ReadPacket(0, pkt))
+      break;
+    if (!pkt)
+      continue;
+    if (pkt->iStreamId == DMX_SPECIALID_STREAMCHANGE)
+      return pkt;
+    PVR->FreeDemuxPacket(pkt);
+  }
+
+  return m_liveBuffer.Next();
+}
+
+bool cVNSIDemux::ReadPacket(int timeout, DemuxPacket*& pkt)
+{
+  pkt = nullptr;
+
+  uint64_t offset = cLiveBuffer::kNoRecord;
+  std::unique_ptr<cResponsePacket> resp;
+  if (IsRunning())
+    resp = ReadPrefetched(timeout, offset);
+  else
+    resp = ReadMessage(timeout, g_iConnectTimeout * 1000);
 
   if(resp == nullptr)
-    return PVR->AllocateDemuxPacket(0);
+    return false;
 
   if (resp->getChannelID() != VNSI_CHANNEL_STREAM)
   {
-    return nullptr;
+    return true;
   }
 
+  // from here on the message is consumed, pkt tells if there is something
+  // for the player
+
   if (resp->getOpCodeID() == VNSI_STREAM_CHANGE)
   {
     StreamChange(resp.get());
-    DemuxPacket* pkt = PVR->AllocateDemuxPacket(0);
+    pkt = PVR->AllocateDemuxPacket(0);
     pkt->iStreamId  = DMX_SPECIALID_STREAMCHANGE;
-    return pkt;
+    return true;
   }
   else if (resp->getOpCodeID() == VNSI_STREAM_STATUS)
   {
@@ -130,9 +346,9 @@ DemuxPacket* cVNSIDemux::Read()
     // send stream updates only if there are changes
     if(StreamContentInfo(resp.get()))
     {
-      DemuxPacket* pkt = PVR->AllocateDemuxPacket(0);
+      pkt = PVR->AllocateDemuxPacket(0);
       pkt->iStreamId  = DMX_SPECIALID_STREAMCHANGE;
-      return pkt;
+      return true;
     }
   }
   else if (resp->getOpCodeID() == VNSI_STREAM_MUXPKT)
@@ -143,28 +359,43 @@ DemuxPacket* cVNSIDemux::Read()
     // stream found ?
     if(pid >= 0 && resp->getMuxSerial() == m_MuxPacketSerial)
     {
-      DemuxPacket* p = (DemuxPacket*)resp->stealUserData();
-      p->iSize = resp->getUserDataLength();
-      p->duration = (double)resp->getDuration() * DVD_TIME_BASE / 1000000;
-      p->dts = (double)resp->getDTS() * DVD_TIME_BASE / 1000000;
-      p->pts = (double)resp->getPTS() * DVD_TIME_BASE / 1000000;
-      p->iStreamId = pid;
-
-      int idx = -1;
-      for (int i=0; i<m_streams.iStreamCount; i++)
+      DemuxPacket* p = MuxPacket(resp.get());
+
+      // the receiver thread buffers the packets it reads itself
+      if (!IsRunning() && m_liveBuffer.IsEnabled())
+        m_liveBuffer.Add(p, &offset);
+
+      if (!m_liveBuffer.Played(offset))
       {
-        if (m_streams.stream[i].iPID == pid)
-          idx = i;
+        // replayed from the live buffer already
+        m_latency.Discarded();
+        return true;
       }
-      xbmc_codec_type_t type = XBMC_CODEC_TYPE_UNKNOWN;
-      if (idx >= 0)
-        type = m_streams.stream[idx].iCodecType;
 
-      return p;
+      resp->stealUserData();
+      pkt = p;
+
+      int idx = m_streamIndex.Find(pid);
+      if (m_latency.Packet(idx, pid, p->iSize, resp->getDTS(), IsRunning() ? m_prefetchQueue.Size() : 0))
+        m_latency.Log();
+
+      if (m_zapper)
+      {
+        // first picture, or first sound on radio channels
+        SStreamInfo* props = FindStream(pid);
+        if (props && (props->iCodecType == XBMC_CODEC_TYPE_VIDEO ||
+                      (!m_hasVideo && props->iCodecType == XBMC_CODEC_TYPE_AUDIO)))
+        {
+          m_zapper->ReportZap(m_zapWarm, (int)(GetTimeMs() - m_zapStart));
+          m_zapper = nullptr;
+        }
+      }
+      return true;
     }
     else if (pid >= 0 && resp->getMuxSerial() != m_MuxPacketSerial)
     {
       // ignore silently, may happen after a seek
+      m_latency.Discarded();
     }
     else
     {
@@ -173,81 +404,305 @@ DemuxPacket* cVNSIDemux::Read()
   }
   else if (resp->getOpCodeID() == VNSI_STREAM_TIMES)
   {
-    m_bTimeshift = resp->extract_U8();
-    m_ReferenceTime = resp->extract_U32();
-    m_ReferenceDTS = (double)resp->extract_U64();
-    m_minPTS = (double)resp->extract_U64();
-    m_maxPTS = (double)resp->extract_U64();
+    StreamTimes(resp.get());
   }
   else if (resp->getOpCodeID() == VNSI_STREAM_BUFFERSTATS)
   {
     m_bTimeshift = resp->extract_U8();
-    m_minPTS = (resp->extract_U32() - m_ReferenceTime) * DVD_TIME_BASE + m_ReferenceDTS;
-    m_maxPTS = (resp->extract_U32() - m_ReferenceTime) * DVD_TIME_BASE + m_ReferenceDTS;
+    uint32_t start = resp->extract_U32();
+    uint32_t end = resp->extract_U32();
+
+    CLockObject lock(m_statusMutex);
+    // buffer bounds are wall clock seconds, signed 64 bit math so a start
+    // before the reference time can't wrap with a 32 bit time_t
+    m_minPTS = ((int64_t)start - (int64_t)m_ReferenceTime) * 1000000 + m_ReferenceDTS;
+    m_maxPTS = ((int64_t)end - (int64_t)m_ReferenceTime) * 1000000 + m_ReferenceDTS;
   }
   else if (resp->getOpCodeID() == VNSI_STREAM_REFTIME)
   {
-    m_ReferenceTime = resp->extract_U32();
-    m_ReferenceDTS = (double)resp->extract_U64();
+    time_t refTime = resp->extract_U32();
+    int64_t refDTS = resp->extract_U64();
+
+    {
+      CLockObject lock(m_statusMutex);
+      m_ReferenceTime = refTime;
+      m_ReferenceDTS = refDTS;
+    }
+    m_latency.SetReference(refTime, refDTS);
   }
 
-  return PVR->AllocateDemuxPacket(0);
+  return true;
 }
 
-void cVNSIDemux::ReadStatus()
+void cVNSIDemux::StartPrefetch()
 {
+  size_t packets = g_iPrefetchPackets > 0 ? g_iPrefetchPackets : DEFAULT_PREFETCH_PKTS;
+  m_prefetchQueue.Resize(packets);
+  m_prefetchBytes = 0;
+  m_prefetchMaxBytes = (size_t)(g_iPrefetchKBytes > 0 ? g_iPrefetchKBytes : DEFAULT_PREFETCH_KB) * 1024;
+  m_prefetchHighPackets = 0;
+  m_prefetchHighBytes = 0;
+  m_prefetchDropped = 0;
+  m_receiverLost = false;
+  m_liveGap = false;
+
+  XBMC->Log(LOG_DEBUG, "%s - receiving in background, queue %d packets / %d KiB", __FUNCTION__,
+            (int)packets, (int)(m_prefetchMaxBytes / 1024));
+  CreateThread();
+}
 
-  if (m_connectionLost || !m_statusCon.IsConnected())
-  {
+void cVNSIDemux::StopPrefetch()
+{
+  if (!IsRunning())
     return;
-  }
 
-  while (true)
+  StopThread(-1);
+  m_prefetchSpace.Signal();
+  StopThread();
+
+  XBMC->Log(LOG_DEBUG, "%s - receive queue high water: %d packets / %d KiB, %llu dropped", __FUNCTION__,
+            (int)m_prefetchHighPackets, (int)(m_prefetchHighBytes / 1024), (unsigned long long)m_prefetchDropped);
+
+  SQueued queued;
+  while (m_prefetchQueue.Pop(queued))
+    delete queued.resp;
+  for (auto overflow : m_prefetchOverflow)
+    delete overflow;
+  m_prefetchOverflow.clear();
+  m_prefetchBytes = 0;
+}
+
+void *cVNSIDemux::Process()
+{
+  m_prefetchThread = std::this_thread::get_id();
+
+  while (!IsStopped() && !m_receiverLost)
   {
-    auto resp = m_statusCon.ReadStatus();
+    // control messages that did not fit keep their place in the stream
+    while (!m_prefetchOverflow.empty() && PushPrefetched(m_prefetchOverflow.front()))
+      m_prefetchOverflow.pop_front();
+
+    bool pending;
+    {
+      CLockObject lock(m_responseMutex);
+      pending = m_responseSerial != 0;
+    }
+
+    // wait for the consumer unless a request needs its response. With a
+    // live buffer keep reading, e.g. while paused, the buffer takes the stream
+    if (!pending && !m_liveBuffer.IsEnabled() &&
+        (m_prefetchQueue.Full() || m_prefetchBytes >= m_prefetchMaxBytes))
+    {
+      m_prefetchSpace.Wait(100);
+      continue;
+    }
+
+    auto resp = ReadMessage(100, g_iConnectTimeout * 1000);
     if (!resp)
+      continue;
+
+    if (resp->getChannelID() == VNSI_CHANNEL_REQUEST_RESPONSE)
     {
-      if ((time(nullptr) - m_lastStatus) > 2)
+      CLockObject lock(m_responseMutex);
+      if (resp->getRequestID() == m_responseSerial)
       {
-        cRequestPacket vrp;
-        vrp.init(VNSI_CHANNELSTREAM_STATUS_REQUEST);
-        if (!TransmitMessage(&vrp))
-        {
-          SignalConnectionLost();
-        }
+        m_response = std::move(resp);
+        m_responseEvent.Signal();
       }
-      break;
+      continue;
     }
 
-    if (resp->getOpCodeID() == VNSI_STREAM_TIMES)
+    bool muxPacket = resp->getChannelID() == VNSI_CHANNEL_STREAM && resp->getOpCodeID() == VNSI_STREAM_MUXPKT;
+    uint64_t offset;
+    bool buffered = BufferMuxPacket(resp.get(), offset);
+
+    // once the live buffer took over, the player gets all following mux
+    // packets from there, see Read()
+    if (muxPacket && m_liveGap)
     {
-      m_bTimeshift = resp->extract_U8();
-      m_ReferenceTime = resp->extract_U32();
-      m_ReferenceDTS = (double)resp->extract_U64();
-      m_minPTS = (double)resp->extract_U64();
-      m_maxPTS = (double)resp->extract_U64();
+      if (!buffered)
+        m_prefetchDropped++;
+      continue;
     }
-    else if (resp->getOpCodeID() == VNSI_STREAM_SIGNALINFO)
+
+    if (m_prefetchOverflow.empty() && PushPrefetched(resp.get(), offset))
     {
-      StreamSignalInfo(resp.get());
+      resp.release();
+      continue;
     }
-    else if (resp->getOpCodeID() == VNSI_STREAM_STATUS)
+
+    // the queue is full, because playback is paused or a seek or close
+    // waits for its response. Mux packets are kept by the live buffer if
+    // there is one, without they are stale anyway. Stream changes and the
+    // like have to reach the player in any case
+    if (buffered)
+      m_liveGap = true;
+    else if (muxPacket)
+      m_prefetchDropped++;
+    else
+      m_prefetchOverflow.push_back(resp.release());
+  }
+
+  m_prefetchData.Signal();
+  return NULL;
+}
+
+bool cVNSIDemux::PushPrefetched(cResponsePacket* resp, uint64_t offset)
+{
+  size_t bytes = resp->getUserDataLength();
+  if (!m_prefetchQueue.Push({resp, offset}))
+    return false;
+
+  size_t queued = m_prefetchQueue.Size();
+  size_t queuedBytes = (m_prefetchBytes += bytes);
+  if (queued > m_prefetchHighPackets)
+    m_prefetchHighPackets = queued;
+  if (queuedBytes > m_prefetchHighBytes)
+    m_prefetchHighBytes = queuedBytes;
+
+  m_prefetchData.Signal();
+  return true;
+}
+
+bool cVNSIDemux::BufferMuxPacket(cResponsePacket* resp, uint64_t &offset)
+{
+  offset = cLiveBuffer::kNoRecord;
+  if (!m_liveBuffer.IsEnabled() || resp->getChannelID() != VNSI_CHANNEL_STREAM ||
+      resp->getOpCodeID() != VNSI_STREAM_MUXPKT || resp->getMuxSerial() != m_MuxPacketSerial)
+    return false;
+
+  DemuxPacket* p = MuxPacket(resp);
+  if (!p)
+    return false;
+
+  m_liveBuffer.Add(p, &offset);
+  return offset != cLiveBuffer::kNoRecord;
+}
+
+DemuxPacket* cVNSIDemux::MuxPacket(cResponsePacket* resp)
+{
+  // the payload of a mux packet is allocated as DemuxPacket already
+  DemuxPacket* p = (DemuxPacket*)resp->getUserData();
+  if (!p)
+    return nullptr;
+
+  p->iSize = resp->getUserDataLength();
+  p->duration = (double)ToDVDTime(resp->getDuration());
+  p->dts = (double)ToDVDTime(resp->getDTS());
+  p->pts = (double)ToDVDTime(resp->getPTS());
+  p->iStreamId = resp->getStreamID();
+  return p;
+}
+
+void cVNSIDemux::SignalConnectionLost()
+{
+  // on the receiver thread only flag it, closing the session from here
+  // would free packets and buffers the demux thread is working with
+  if (IsRunning() && std::this_thread::get_id() == m_prefetchThread)
+  {
+    if (!m_receiverLost)
+      XBMC->Log(LOG_ERROR, "%s - connection lost on the receiver thread", __FUNCTION__);
+    m_receiverLost = true;
+    m_prefetchData.Signal();
+    m_responseEvent.Signal();
+    return;
+  }
+
+  cVNSISession::SignalConnectionLost();
+}
+
+std::unique_ptr<cResponsePacket> cVNSIDemux::ReadPrefetched(int timeout, uint64_t &offset)
+{
+  SQueued queued;
+  if (!m_prefetchQueue.Pop(queued))
+  {
+    if (timeout <= 0)
+      return nullptr;
+    m_prefetchData.Wait(timeout);
+    if (!m_prefetchQueue.Pop(queued))
+      return nullptr;
+  }
+
+  m_prefetchBytes -= queued.resp->getUserDataLength();
+  m_prefetchSpace.Signal();
+  offset = queued.offset;
+  return std::unique_ptr<cResponsePacket>(queued.resp);
+}
+
+std::unique_ptr<cResponsePacket> cVNSIDemux::ReadResult(cRequestPacket* vrp)
+{
+  if (!IsRunning())
+    return cVNSISession::ReadResult(vrp);
+
+  // the receiver thread reads the socket, let it route the response to us
+  CLockObject requestLock(m_requestMutex);
+  {
+    CLockObject lock(m_responseMutex);
+    m_responseSerial = vrp->getSerial();
+    m_response.reset();
+    m_responseEvent.Reset();
+  }
+  m_prefetchSpace.Signal();
+
+  bool ok = TransmitMessage(vrp) && m_responseEvent.Wait(g_iConnectTimeout * 1000);
+
+  if (m_receiverLost)
+  {
     {
-      StreamStatus(resp.get());
+      CLockObject lock(m_responseMutex);
+      m_responseSerial = 0;
     }
+    SignalConnectionLost();
+    return nullptr;
+  }
 
-    m_lastStatus = time(nullptr);
+  CLockObject lock(m_responseMutex);
+  m_responseSerial = 0;
+  if (!ok)
+  {
+    XBMC->Log(LOG_ERROR, "%s - request timed out after %d seconds", __FUNCTION__, g_iConnectTimeout);
+    return nullptr;
   }
+  return std::move(m_response);
 }
 
-bool cVNSIDemux::GetStreamTimes(PVR_STREAM_TIMES *times)
+void cVNSIDemux::StatusMessage(cResponsePacket *resp)
 {
-  ReadStatus();
+  if (resp->getOpCodeID() == VNSI_STREAM_TIMES)
+  {
+    StreamTimes(resp);
+  }
+  else if (resp->getOpCodeID() == VNSI_STREAM_SIGNALINFO)
+  {
+    StreamSignalInfo(resp);
+  }
+  else if (resp->getOpCodeID() == VNSI_STREAM_STATUS)
+  {
+    StreamStatus(resp);
+  }
+}
+
+void cVNSIDemux::RequestStatus()
+{
+  if (m_connectionLost)
+    return;
+
+  // the reply arrives on the status connection
+  cRequestPacket vrp;
+  vrp.init(VNSI_CHANNELSTREAM_STATUS_REQUEST);
+  if (!TransmitMessage(&vrp))
+  {
+    XBMC->Log(LOG_ERROR, "%s - failed to request stream status", __FUNCTION__);
+  }
+}
 
+bool cVNSIDemux::GetStreamTimes(PVR_STREAM_TIMES *times)
+{
+  CLockObject lock(m_statusMutex);
   times->startTime = m_ReferenceTime;
-  times->ptsStart = m_ReferenceDTS;
-  times->ptsBegin = m_minPTS;
-  times->ptsEnd = m_maxPTS;
+  times->ptsStart = ToDVDTime(m_ReferenceDTS);
+  times->ptsBegin = ToDVDTime(m_minPTS);
+  times->ptsEnd = ToDVDTime(m_maxPTS);
   return true;
 }
 
@@ -256,8 +711,16 @@ bool cVNSIDemux::SeekTime(int time, bool backwards, double *startpts)
   cRequestPacket vrp;
 
   int64_t seek_pts = (int64_t)time * 1000;
+
+  // packets decoded ahead are from before the seek point
+  ClearBatch();
+  m_liveGap = false;
+
+  if (m_liveBuffer.Seek((double)ToDVDTime(seek_pts), backwards, startpts))
+    return true;
+
   if (startpts)
-    *startpts = seek_pts;
+    *startpts = (double)ToDVDTime(seek_pts);
 
   vrp.init(VNSI_CHANNELSTREAM_SEEK);
   vrp.add_S64(seek_pts);
@@ -274,6 +737,8 @@ bool cVNSIDemux::SeekTime(int time, bool backwards, double *startpts)
 
   if (retCode == VNSI_RET_OK)
   {
+    // clear first, the receiver buffers packets of the new serial right away
+    m_liveBuffer.Clear();
     m_MuxPacketSerial = serial;
     return true;
   }
@@ -285,58 +750,121 @@ bool cVNSIDemux::SwitchChannel(const PVR_CHANNEL &channelinfo)
 {
   XBMC->Log(LOG_DEBUG, "changing to channel %d", channelinfo.iChannelNumber);
 
-  cRequestPacket vrp1;
-  vrp1.init(VNSI_GETSETUP);
-  vrp1.add_String(CONFNAME_TIMESHIFT);
+  // the timeshift setup is asked once per session, the status socket is
+  // handed over with the open request, so all requests go out back to back
+  cRequestPacket vrpSetup;
+  cRequestPacket vrpOpen;
+  cRequestPacket vrpStatus;
+  cRequestPacket* vrps[3];
+  size_t count = 0;
 
-  auto resp = ReadResult(&vrp1);
-  if (!resp)
+  if (s_timeshiftSetup < 0)
   {
-    XBMC->Log(LOG_ERROR, "%s - failed to get timeshift mode", __FUNCTION__);
-    return false;
+    vrpSetup.init(VNSI_GETSETUP);
+    vrpSetup.add_String(CONFNAME_TIMESHIFT);
+    vrps[count++] = &vrpSetup;
+  }
+
+  vrpOpen.init(VNSI_CHANNELSTREAM_OPEN);
+  vrpOpen.add_U32(channelinfo.iUniqueId);
+  vrpOpen.add_S32(g_iPriority);
+  vrpOpen.add_U8(g_iTimeshift);
+  vrps[count++] = &vrpOpen;
+
+  // with the receiver running ReadResult() sends each request itself
+  bool running = IsRunning();
+  bool sent = running || TransmitMessages(vrps, count);
+
+  // the status connection is still being prepared in the background while
+  // the server tunes, the socket request queues up behind the open
+  int fd = -1;
+  if (sent && GetProtocol() >= 13)
+  {
+    fd = m_statusCon.TakeSocket();
+    if (fd >= 0)
+    {
+      vrpStatus.init(VNSI_CHANNELSTREAM_STATUS_SOCKET);
+      vrpStatus.add_S32(fd);
+      vrps[count] = &vrpStatus;
+      sent = running || TransmitMessages(&vrps[count], 1);
+      count++;
+    }
+  }
+
+  std::unique_ptr<cResponsePacket> resp[3];
+  if (!sent)
+  {
+    SignalConnectionLost();
+  }
+  else if (running)
+  {
+    // the receiver routes one response at a time
+    for (size_t i = 0; i < count; i++)
+      resp[i] = ReadResult(vrps[i]);
+  }
+  else
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      resp[i] = ReadResponse(vrps[i]);
+      if (!resp[i])
+        break;
+    }
   }
-  m_bTimeshift = resp->extract_U32();
 
-  cRequestPacket vrp2;
-  vrp2.init(VNSI_CHANNELSTREAM_OPEN);
-  vrp2.add_U32(channelinfo.iUniqueId);
-  vrp2.add_S32(g_iPriority);
-  vrp2.add_U8(g_iTimeshift);
+  size_t idx = 0;
+  if (vrps[0] == &vrpSetup)
+  {
+    if (!resp[idx])
+    {
+      XBMC->Log(LOG_ERROR, "%s - failed to get timeshift mode", __FUNCTION__);
+      return false;
+    }
+    s_timeshiftSetup = resp[idx++]->extract_U32();
+  }
+  m_bTimeshift = s_timeshiftSetup != 0;
 
-  if (!ReadSuccess(&vrp2))
+  uint32_t retCode = resp[idx] ? resp[idx]->extract_U32() : VNSI_RET_ERROR;
+  idx++;
+  if (retCode != VNSI_RET_OK)
   {
-    XBMC->Log(LOG_ERROR, "%s - failed to set channel", __FUNCTION__);
+    XBMC->Log(LOG_ERROR, "%s - failed to set channel, error code '%i'", __FUNCTION__, retCode);
+    m_statusCon.Stop();
     return false;
   }
 
-  if (GetProtocol() >= 13)
+  if (fd >= 0)
   {
-    int fd = m_statusCon.GetSocket();
-    if (fd >= 0)
+    if (resp[idx] && resp[idx]->extract_U32() == VNSI_RET_OK)
     {
-      cRequestPacket vrp;
-      vrp.init(VNSI_CHANNELSTREAM_STATUS_SOCKET);
-      vrp.add_S32(fd);
-      if (ReadSuccess(&vrp))
-      {
-        m_statusCon.ReleaseServerClient();
-        XBMC->Log(LOG_DEBUG, "%s - established status connection", __FUNCTION__);
-      }
+      m_statusCon.ReleaseServerClient();
+      m_statusCon.Start();
+      XBMC->Log(LOG_DEBUG, "%s - established status connection", __FUNCTION__);
     }
+    else
+      m_statusCon.Stop();
   }
 
   m_channelinfo = channelinfo;
-  m_streams.iStreamCount = 0;
+  ClearBatch();
+  m_latency.Reset();
+  m_streams.clear();
+  BuildStreamIndex();
+  m_liveBuffer.Reset();
   m_MuxPacketSerial = 0;
-  m_ReferenceTime = 0;
-  m_minPTS = 0;
-  m_maxPTS = 0;
+  {
+    CLockObject lock(m_statusMutex);
+    m_ReferenceTime = 0;
+    m_minPTS = 0;
+    m_maxPTS = 0;
+  }
 
   return true;
 }
 
 bool cVNSIDemux::GetSignalStatus(PVR_SIGNAL_STATUS &qualityinfo)
 {
+  CLockObject lock(m_statusMutex);
   if (m_Quality.fe_name.empty())
     return true;
 
@@ -350,84 +878,120 @@ bool cVNSIDemux::GetSignalStatus(PVR_SIGNAL_STATUS &qualityinfo)
   return true;
 }
 
+// the same handful of codec names come with every stream change
+static xbmc_codec_t LookupCodec(const char *name)
+{
+  static cNameCache<xbmc_codec_t> codecs;
+
+  return codecs.Get(name, [](const char *name) { return CodecDescriptor::GetCodecByName(name).Codec(); });
+}
+
 void cVNSIDemux::StreamChange(cResponsePacket *resp)
 {
-  int count = 0;
-  m_streams.iStreamCount = 0;
+  m_streams.clear();
+  BuildStreamIndex();
+
+  // buffered packets belong to the old stream setup
+  m_liveBuffer.Reset();
 
   while (resp->getRemainingLength() >= 4 + 1)
   {
     uint32_t    pid = resp->extract_U32();
     const char* type  = resp->extract_String();
 
-    memset(&m_streams.stream[count], 0, sizeof(PVR_STREAM_PROPERTIES::PVR_STREAM));
-
-    CodecDescriptor codecId = CodecDescriptor::GetCodecByName(type);
-    if (codecId.Codec().codec_type != XBMC_CODEC_TYPE_UNKNOWN)
-    {
-      m_streams.stream[count].iPID = pid;
-      m_streams.stream[count].iCodecType = codecId.Codec().codec_type;
-      m_streams.stream[count].iCodecId = codecId.Codec().codec_id;
-    }
-    else
+    xbmc_codec_t codec = LookupCodec(type);
+    if (codec.codec_type == XBMC_CODEC_TYPE_UNKNOWN)
     {
+      m_streams.clear();
       return;
     }
 
-    if (codecId.Codec().codec_type == XBMC_CODEC_TYPE_AUDIO)
+    SStreamInfo info;
+    memset(&info, 0, sizeof(info));
+    info.iPID = pid;
+    info.iCodecType = codec.codec_type;
+    info.iCodecId = codec.codec_id;
+
+    if (codec.codec_type == XBMC_CODEC_TYPE_AUDIO)
     {
       const char *language = resp->extract_String();
 
-      m_streams.stream[count].iChannels = resp->extract_U32();
-      m_streams.stream[count].iSampleRate = resp->extract_U32();
-      m_streams.stream[count].iBlockAlign = resp->extract_U32();
-      m_streams.stream[count].iBitRate = resp->extract_U32();
-      m_streams.stream[count].iBitsPerSample = resp->extract_U32();
-      m_streams.stream[count].strLanguage[0] = language[0];
-      m_streams.stream[count].strLanguage[1] = language[1];
-      m_streams.stream[count].strLanguage[2] = language[2];
-      m_streams.stream[count].strLanguage[3] = 0;
+      info.iChannels = resp->extract_U32();
+      info.iSampleRate = resp->extract_U32();
+      info.iBlockAlign = resp->extract_U32();
+      info.iBitRate = resp->extract_U32();
+      info.iBitsPerSample = resp->extract_U32();
+      info.strLanguage[0] = language[0];
+      info.strLanguage[1] = language[1];
+      info.strLanguage[2] = language[2];
     }
-    else if (codecId.Codec().codec_type == XBMC_CODEC_TYPE_VIDEO)
+    else if (codec.codec_type == XBMC_CODEC_TYPE_VIDEO)
     {
-      m_streams.stream[count].iFPSScale = resp->extract_U32();
-      m_streams.stream[count].iFPSRate = resp->extract_U32();
-      m_streams.stream[count].iHeight = resp->extract_U32();
-      m_streams.stream[count].iWidth = resp->extract_U32();
-      m_streams.stream[count].fAspect = (float)resp->extract_Double();
-      m_streams.stream[count].strLanguage[0] = 0;
-      m_streams.stream[count].strLanguage[1] = 0;
-      m_streams.stream[count].strLanguage[2] = 0;
-      m_streams.stream[count].strLanguage[3] = 0;
+      info.iFPSScale = resp->extract_U32();
+      info.iFPSRate = resp->extract_U32();
+      info.iHeight = resp->extract_U32();
+      info.iWidth = resp->extract_U32();
+      info.fAspect = (float)resp->extract_Double();
     }
-    else if (codecId.Codec().codec_type == XBMC_CODEC_TYPE_SUBTITLE)
+    else if (codec.codec_type == XBMC_CODEC_TYPE_SUBTITLE)
     {
       const char *language = resp->extract_String();
       uint32_t composition_id = resp->extract_U32();
       uint32_t ancillary_id = resp->extract_U32();
-      m_streams.stream[count].strLanguage[0] = language[0];
-      m_streams.stream[count].strLanguage[1] = language[1];
-      m_streams.stream[count].strLanguage[2] = language[2];
-      m_streams.stream[count].strLanguage[3] = 0;
-      m_streams.stream[count].iSubtitleInfo = (composition_id & 0xffff) | ((ancillary_id & 0xffff) << 16);
+      info.strLanguage[0] = language[0];
+      info.strLanguage[1] = language[1];
+      info.strLanguage[2] = language[2];
+      info.iSubtitleInfo = (composition_id & 0xffff) | ((ancillary_id & 0xffff) << 16);
     }
-    else if (codecId.Codec().codec_type == XBMC_CODEC_TYPE_RDS)
+    else if (codec.codec_type == XBMC_CODEC_TYPE_RDS)
     {
       const char *language = resp->extract_String();
-      uint32_t rel_channel_pid = resp->extract_U32();
-      m_streams.stream[count].strLanguage[0] = language[0];
-      m_streams.stream[count].strLanguage[1] = language[1];
-      m_streams.stream[count].strLanguage[2] = language[2];
-      m_streams.stream[count].strLanguage[3] = 0;
+      resp->extract_U32(); // rel_channel_pid
+      info.strLanguage[0] = language[0];
+      info.strLanguage[1] = language[1];
+      info.strLanguage[2] = language[2];
     }
     else
     {
-      m_streams.iStreamCount = 0;
+      m_streams.clear();
       return;
     }
-    count++;
+
+    m_streams.push_back(info);
+    m_liveBuffer.AddStream(pid, type);
+  }
+  BuildStreamIndex();
+}
+
+void cVNSIDemux::BuildStreamIndex()
+{
+  m_streamIndex.Clear();
+  m_hasVideo = false;
+
+  for (size_t i = 0; i < m_streams.size(); i++)
+  {
+    if (m_streams[i].iCodecType == XBMC_CODEC_TYPE_VIDEO)
+      m_hasVideo = true;
+
+    m_streamIndex.Add(m_streams[i].iPID, i);
+  }
+}
+
+cVNSIDemux::SStreamInfo* cVNSIDemux::FindStream(uint32_t pid)
+{
+  if (!cStreamIndex::Covers(pid))
+  {
+    // not a transport stream pid, fall back to a search
+    for (auto &info : m_streams)
+    {
+      if (info.iPID == pid)
+        return &info;
+    }
+    return nullptr;
   }
-  m_streams.iStreamCount = count;
+
+  int idx = m_streamIndex.Find(pid);
+  return idx >= 0 ? &m_streams[idx] : nullptr;
 }
 
 void cVNSIDemux::StreamStatus(cResponsePacket *resp)
@@ -445,6 +1009,7 @@ void cVNSIDemux::StreamSignalInfo(cResponsePacket *resp)
   const char* name = resp->extract_String();
   const char* status = resp->extract_String();
 
+  CLockObject lock(m_statusMutex);
   m_Quality.fe_name   = name;
   m_Quality.fe_status = status;
   m_Quality.fe_snr    = resp->extract_U32();
@@ -453,32 +1018,58 @@ void cVNSIDemux::StreamSignalInfo(cResponsePacket *resp)
   m_Quality.fe_unc    = resp->extract_U32();
 }
 
+void cVNSIDemux::StreamTimes(cResponsePacket *resp)
+{
+  m_bTimeshift = resp->extract_U8();
+  time_t refTime = resp->extract_U32();
+  int64_t refDTS = resp->extract_U64();
+  int64_t minPTS = resp->extract_U64();
+  int64_t maxPTS = resp->extract_U64();
+
+  {
+    CLockObject lock(m_statusMutex);
+    m_ReferenceTime = refTime;
+    m_ReferenceDTS = refDTS;
+    m_minPTS = minPTS;
+    m_maxPTS = maxPTS;
+  }
+  m_latency.SetReference(refTime, refDTS);
+}
+
 bool cVNSIDemux::StreamContentInfo(cResponsePacket *resp)
 {
+  // only changes a decoder or the stream selection cares about are worth
+  // a stream change, others like the bitrate are taken over silently
+  bool changed = false;
+
   while (resp->getRemainingLength() >= 4)
   {
     uint32_t pid = resp->extract_U32();
 
-    PVR_STREAM_PROPERTIES::PVR_STREAM* props = nullptr;
-    for (int i=0; i<m_streams.iStreamCount; i++)
-    {
-      if (m_streams.stream[i].iPID == pid)
-      {
-        props = &m_streams.stream[i];
-        break;
-      }
-    }
+    SStreamInfo* props = FindStream(pid);
     if (props)
     {
       if (props->iCodecType == XBMC_CODEC_TYPE_AUDIO)
       {
         const char *language = resp->extract_String();
-          
-        props->iChannels = resp->extract_U32();
-        props->iSampleRate = resp->extract_U32();
-        props->iBlockAlign = resp->extract_U32();
-        props->iBitRate = resp->extract_U32();
-        props->iBitsPerSample = resp->extract_U32();
+        uint32_t channels = resp->extract_U32();
+        uint32_t sampleRate = resp->extract_U32();
+        uint32_t blockAlign = resp->extract_U32();
+        uint32_t bitRate = resp->extract_U32();
+        uint32_t bitsPerSample = resp->extract_U32();
+
+        if (props->iChannels != channels ||
+            props->iSampleRate != sampleRate ||
+            props->iBlockAlign != blockAlign ||
+            props->iBitsPerSample != bitsPerSample ||
+            strncmp(props->strLanguage, language, 3) != 0)
+          changed = true;
+
+        props->iChannels = channels;
+        props->iSampleRate = sampleRate;
+        props->iBlockAlign = blockAlign;
+        props->iBitRate = bitRate;
+        props->iBitsPerSample = bitsPerSample;
         props->strLanguage[0] = language[0];
         props->strLanguage[1] = language[1];
         props->strLanguage[2] = language[2];
@@ -486,19 +1077,37 @@ bool cVNSIDemux::StreamContentInfo(cResponsePacket *resp)
       }
       else if (props->iCodecType == XBMC_CODEC_TYPE_VIDEO)
       {
-        props->iFPSScale = resp->extract_U32();
-        props->iFPSRate = resp->extract_U32();
-        props->iHeight = resp->extract_U32();
-        props->iWidth = resp->extract_U32();
-        props->fAspect = (float)resp->extract_Double();
+        uint32_t fpsScale = resp->extract_U32();
+        uint32_t fpsRate = resp->extract_U32();
+        uint32_t height = resp->extract_U32();
+        uint32_t width = resp->extract_U32();
+        float aspect = (float)resp->extract_Double();
+
+        if (props->iFPSScale != fpsScale ||
+            props->iFPSRate != fpsRate ||
+            props->iHeight != height ||
+            props->iWidth != width ||
+            props->fAspect != aspect)
+          changed = true;
+
+        props->iFPSScale = fpsScale;
+        props->iFPSRate = fpsRate;
+        props->iHeight = height;
+        props->iWidth = width;
+        props->fAspect = aspect;
       }
       else if (props->iCodecType == XBMC_CODEC_TYPE_SUBTITLE)
       {
         const char *language = resp->extract_String();
         uint32_t composition_id = resp->extract_U32();
         uint32_t ancillary_id = resp->extract_U32();
-          
-        props->iSubtitleInfo = (composition_id & 0xffff) | ((ancillary_id & 0xffff) << 16);
+        int subtitleInfo = (composition_id & 0xffff) | ((ancillary_id & 0xffff) << 16);
+
+        if (props->iSubtitleInfo != subtitleInfo ||
+            strncmp(props->strLanguage, language, 3) != 0)
+          changed = true;
+
+        props->iSubtitleInfo = subtitleInfo;
         props->strLanguage[0] = language[0];
         props->strLanguage[1] = language[1];
         props->strLanguage[2] = language[2];
@@ -511,25 +1120,28 @@ bool cVNSIDemux::StreamContentInfo(cResponsePacket *resp)
       break;
     }
   }
-  return true;
+  return changed;
 }
 
 //-----------------------------------------------------------------------------
 //
 //-----------------------------------------------------------------------------
 
-int CVNSIDemuxStatus::GetSocket()
+bool CVNSIDemuxStatus::Prepare()
 {
-  Close();
+  if (m_fd >= 0 && ProbeSocket())
+    return true;
+
+  Disconnect();
 
   if (!Open(g_szHostname, g_iPort))
   {
-    return -1;
+    return false;
   }
 
   if (!Login())
   {
-    return -1;
+    return false;
   }
 
   cRequestPacket vrp;
@@ -538,28 +1150,99 @@ int CVNSIDemuxStatus::GetSocket()
   if (!resp)
   {
     XBMC->Log(LOG_ERROR, "%s - failed to get socket", __FUNCTION__);
+    return false;
+  }
+  m_fd = resp->extract_S32();
+  return m_fd >= 0;
+}
+
+void CVNSIDemuxStatus::PrepareAsync()
+{
+  WaitPrepared();
+  m_preparer = std::thread([this] { Prepare(); });
+}
+
+void CVNSIDemuxStatus::WaitPrepared()
+{
+  if (m_preparer.joinable())
+    m_preparer.join();
+}
+
+int CVNSIDemuxStatus::TakeSocket()
+{
+  // a failed background attempt gets one more try here
+  WaitPrepared();
+  if (!Prepare())
+  {
+    XBMC->Log(LOG_ERROR, "%s - failed to prepare status connection", __FUNCTION__);
     return -1;
   }
-  int fd = resp->extract_S32();
+
+  int fd = m_fd;
+  m_fd = -1;
   return fd;
 }
 
 void CVNSIDemuxStatus::ReleaseServerClient()
 {
+  // the receiver thread discards the reply
   cRequestPacket vrp;
   vrp.init(VNSI_INVALIDATESOCKET);
-  if (!ReadSuccess(&vrp))
+  if (!TransmitMessage(&vrp))
   {
     XBMC->Log(LOG_ERROR, "%s - failed to release server client", __FUNCTION__);
   }
 }
 
-std::unique_ptr<cResponsePacket> CVNSIDemuxStatus::ReadStatus()
+void CVNSIDemuxStatus::Start()
 {
-  if (!IsOpen())
-    return nullptr;
+  CreateThread();
+}
+
+void CVNSIDemuxStatus::Stop()
+{
+  // a connect in the background gives up after its current attempt
+  m_abort = true;
+  WaitPrepared();
+  m_abort = false;
+
+  Disconnect();
+}
+
+void CVNSIDemuxStatus::Disconnect()
+{
+  // closing wakes up the receiver, it leaves as soon as the socket is gone
+  StopThread(-1);
+  Close();
+  StopThread();
+  m_fd = -1;
+}
+
+void *CVNSIDemuxStatus::Process()
+{
+  time_t lastStatus = time(nullptr);
+
+  while (!IsStopped() && IsOpen())
+  {
+    auto resp = ReadMessage(1000, 10000);
+    if (!resp)
+    {
+      // nothing pushed for a while, ask for it
+      if ((time(nullptr) - lastStatus) > 2)
+      {
+        m_demux.RequestStatus();
+        lastStatus = time(nullptr);
+      }
+      continue;
+    }
+
+    // replies to our own requests carry nothing of interest
+    if (resp->getChannelID() != VNSI_CHANNEL_REQUEST_RESPONSE)
+      m_demux.StatusMessage(resp.get());
+    lastStatus = time(nullptr);
+  }
 
-  return ReadMessage(1, 10000);
+  return NULL;
 }
 
 bool CVNSIDemuxStatus::IsConnected()
@@ -22,11 +22,21 @@
 
 #include "VNSISession.h"
 #include "client.h"
+#include "spscqueue.h"
+#include "livebuffer.h"
+#include "demuxstats.h"
+#include "streamindex.h"
+#include <atomic>
+#include <deque>
+#include <thread>
 #include <string>
 #include <map>
+#include <vector>
 #include "xbmc_pvr_types.h"
 
 class cResponsePacket;
+class cVNSIDemux;
+class cVNSIZapper;
 
 struct SQuality
 {
@@ -38,20 +48,44 @@ struct SQuality
   uint32_t    fe_unc;
 };
 
-class CVNSIDemuxStatus : public cVNSISession
+/*!
+ * Second connection the server pushes stream times and signal info to.
+ * Serviced by its own thread so the demux path never waits on it.
+ */
+class CVNSIDemuxStatus : public cVNSISession, public P8PLATFORM::CThread
 {
 public:
 
-  CVNSIDemuxStatus() = default;
-  virtual ~CVNSIDemuxStatus() = default;
+  CVNSIDemuxStatus(cVNSIDemux &demux) : m_demux(demux) {}
+  virtual ~CVNSIDemuxStatus() { Stop(); }
+
+  bool Prepare();
 
-  int GetSocket();
+  /*!
+   * Prepare() on a background thread, TakeSocket() waits for it
+   */
+  void PrepareAsync();
+  int TakeSocket();
   void ReleaseServerClient();
-  std::unique_ptr<cResponsePacket> ReadStatus();
+  void Start();
+  void Stop();
   bool IsConnected();
+
+protected:
+
+  void *Process(void) override;
+
+private:
+
+  void Disconnect();
+  void WaitPrepared();
+
+  cVNSIDemux &m_demux;
+  int m_fd = -1;      ///< server side socket of this connection, see Prepare()
+  std::thread m_preparer;
 };
 
-class cVNSIDemux : public cVNSISession
+class cVNSIDemux : public cVNSISession, public P8PLATFORM::CThread
 {
 public:
 
@@ -59,7 +93,16 @@ public:
   virtual ~cVNSIDemux();
 
   void Close();
+  bool Connect();
+  bool IsConnected() { return IsOpen() && !m_connectionLost; }
+
+  /*!
+   * IsConnected() that also looks at the socket, the server may have
+   * dropped an idle session without us reading from it
+   */
+  bool IsAlive() { return IsConnected() && ProbeSocket(); }
   bool OpenChannel(const PVR_CHANNEL &channelinfo);
+  void StartZapTimer(cVNSIZapper *zapper, int64_t start, bool warm);
   void Abort();
   bool GetStreamProperties(PVR_STREAM_PROPERTIES* props);
   DemuxPacket* Read();
@@ -70,23 +113,115 @@ public:
   bool SeekTime(int time, bool backwards, double *startpts);
   bool GetStreamTimes(PVR_STREAM_TIMES *times);
 
+  void StatusMessage(cResponsePacket *resp);
+  void RequestStatus();
+
+  /*!
+   * The server's timeshift setup is asked once and shared by all demuxers,
+   * forget it when the data session reconnects
+   */
+  static void ResetServerSetup() { s_timeshiftSetup = -1; }
+
 protected:
 
+  void *Process(void) override;
+  std::unique_ptr<cResponsePacket> ReadResult(cRequestPacket* vrp) override;
+  void SignalConnectionLost() override;
+
   void StreamChange(cResponsePacket *resp);
   void StreamStatus(cResponsePacket *resp);
   void StreamSignalInfo(cResponsePacket *resp);
   bool StreamContentInfo(cResponsePacket *resp);
-  void ReadStatus();
+  bool ReadPacket(int timeout, DemuxPacket*& pkt);
+  DemuxPacket* ReadReplay();
+  void DecodeAhead();
+  bool MessageAvailable();
+  void ClearBatch();
+  void StreamTimes(cResponsePacket *resp);
+  void BuildStreamIndex();
+  struct SStreamInfo;
+  SStreamInfo* FindStream(uint32_t pid);
+  void StartPrefetch();
+  void StopPrefetch();
+  std::unique_ptr<cResponsePacket> ReadPrefetched(int timeout, uint64_t &offset);
+  bool PushPrefetched(cResponsePacket* resp, uint64_t offset = cLiveBuffer::kNoRecord);
+  bool BufferMuxPacket(cResponsePacket* resp, uint64_t &offset);
+  static DemuxPacket* MuxPacket(cResponsePacket* resp);
 
-  PVR_STREAM_PROPERTIES m_streams;
+  // stream setup as announced by the server, only copied into Kodi's
+  // PVR_STREAM_PROPERTIES when asked for
+  struct SStreamInfo
+  {
+    uint32_t iPID;
+    xbmc_codec_type_t iCodecType;
+    unsigned int iCodecId;
+    char strLanguage[4];
+    int iSubtitleInfo;
+    uint32_t iFPSScale;
+    uint32_t iFPSRate;
+    uint32_t iHeight;
+    uint32_t iWidth;
+    float fAspect;
+    uint32_t iChannels;
+    uint32_t iSampleRate;
+    uint32_t iBlockAlign;
+    uint32_t iBitRate;
+    uint32_t iBitsPerSample;
+  };
+  std::vector<SStreamInfo> m_streams;
+  cStreamIndex m_streamIndex;
+  bool m_hasVideo = false;
   PVR_CHANNEL m_channelinfo;
+  std::atomic_bool m_bTimeshift{false};
+  std::atomic<uint32_t> m_MuxPacketSerial{0};
+  static std::atomic<int> s_timeshiftSetup;  ///< server's timeshift setup, -1 until queried
+
+  // written by the status connection as well, guarded by m_statusMutex
+  P8PLATFORM::CMutex m_statusMutex;
   SQuality m_Quality;
-  bool m_bTimeshift;
-  uint32_t m_MuxPacketSerial;
-  time_t m_ReferenceTime;
-  double m_ReferenceDTS;
-  double m_minPTS;
-  double m_maxPTS;
-  CVNSIDemuxStatus m_statusCon;
-  time_t m_lastStatus = 0;
+  time_t m_ReferenceTime = 0;
+  int64_t m_ReferenceDTS = 0;     ///< microseconds, like m_minPTS and m_maxPTS
+  int64_t m_minPTS = 0;
+  int64_t m_maxPTS = 0;
+  CVNSIDemuxStatus m_statusCon{*this};
+
+  cLiveBuffer m_liveBuffer;
+  cDemuxStats m_latency;
+
+  // packets decoded ahead of the player, see DecodeAhead()
+  static const size_t kBatchSize = 32;
+  DemuxPacket* m_batch[kBatchSize];
+  size_t m_batchHead = 0;
+  size_t m_batchCount = 0;
+
+  // time from opening the channel to the first picture
+  cVNSIZapper *m_zapper = nullptr;
+  int64_t m_zapStart = 0;
+  bool m_zapWarm = false;
+
+  // background receiver, see StartPrefetch()
+  struct SQueued
+  {
+    cResponsePacket *resp;
+    uint64_t offset;      ///< where the receiver put a mux packet into the live buffer
+  };
+  cSPSCQueue<SQueued> m_prefetchQueue;
+  std::atomic<size_t> m_prefetchBytes{0};
+  size_t m_prefetchMaxBytes = 0;
+  std::atomic<size_t> m_prefetchHighPackets{0};
+  std::atomic<size_t> m_prefetchHighBytes{0};
+  std::atomic<uint64_t> m_prefetchDropped{0};
+  std::deque<cResponsePacket*> m_prefetchOverflow;  ///< control messages waiting for queue space, receiver only
+  P8PLATFORM::CEvent m_prefetchData;
+  P8PLATFORM::CEvent m_prefetchSpace;
+  std::thread::id m_prefetchThread;
+  std::atomic_bool m_receiverLost{false};           ///< connection lost, handled by the demux thread
+  std::atomic_bool m_liveGap{false};                ///< mux packets went to the live buffer only
+
+  // request issued while the receiver owns the socket
+  P8PLATFORM::CMutex m_requestMutex;
+  P8PLATFORM::CMutex m_responseMutex;
+  P8PLATFORM::CEvent m_responseEvent;
+  uint32_t m_responseSerial = 0;
+  std::unique_ptr<cResponsePacket> m_response;
 };
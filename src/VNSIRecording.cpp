@@ -20,17 +20,23 @@
  */
 
 #include <limits.h>
+#include <algorithm>
 #include "VNSIRecording.h"
 #include "responsepacket.h"
 #include "requestpacket.h"
 #include "vnsicommand.h"
+#include "p8-platform/util/timeutils.h"
 
 #define SEEK_POSSIBLE 0x10 // flag used to check if protocol allows seeks
 
 using namespace ADDON;
+using namespace P8PLATFORM;
+
+std::atomic<uint32_t> cVNSIRecording::s_changes(0);
 
 cVNSIRecording::cVNSIRecording()
 {
+  SetSocketProfile(cVNSISocket::PROFILE_STREAM);
   m_currentPlayingRecordLengthMSec = 0;
 }
 
@@ -42,6 +48,19 @@ cVNSIRecording::~cVNSIRecording()
 bool cVNSIRecording::OpenRecording(const PVR_RECORDING& recinfo)
 {
   m_recinfo = recinfo;
+  m_recordingId = atoi(recinfo.strRecordingId);
+  m_lengthTime = 0;
+  m_partial.reset();
+  if (m_chunkSize == 0)
+  {
+    m_chunkSize = g_iChunkSize > 0 ? g_iChunkSize : DEFAULT_CHUNKSIZE;
+    if (m_chunkSize < kMinChunkSize)
+      m_chunkSize = kMinChunkSize;
+    else if (m_chunkSize > kMaxChunkSize)
+      m_chunkSize = kMaxChunkSize;
+  }
+  m_cache.SetCapacity((size_t)g_iRecCacheMB * 1024 * 1024);
+  ClearReadAhead();
 
   if(!cVNSISession::Open(g_szHostname, g_iPort, "XBMC RecordingStream Receiver"))
     return false;
@@ -51,7 +70,7 @@ bool cVNSIRecording::OpenRecording(const PVR_RECORDING& recinfo)
 
   cRequestPacket vrp;
   vrp.init(VNSI_RECSTREAM_OPEN);
-  vrp.add_U32(atoi(recinfo.strRecordingId));
+  vrp.add_U32(m_recordingId);
 
   auto vresp = ReadResult(&vrp);
   if (!vresp)
@@ -72,8 +91,22 @@ bool cVNSIRecording::OpenRecording(const PVR_RECORDING& recinfo)
 
 void cVNSIRecording::Close()
 {
+  ClearReadAhead();
+  m_partial.reset();
+
   if(IsOpen())
   {
+    if (m_cache.IsEnabled())
+    {
+      cBlockCache::SStats stats = m_cache.GetStats();
+      XBMC->Log(LOG_DEBUG, "%s - recording cache: %llu reads served locally, %llu from server, %d of %d MiB used", __FUNCTION__,
+                (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+                (int)(stats.bytes >> 20), (int)(stats.capacity >> 20));
+    }
+
+    XBMC->Log(LOG_DEBUG, "%s - block size %u KiB, goodput %u KiB/s, rtt %d ms", __FUNCTION__,
+              m_chunkSize / 1024, m_goodput / 1024, m_rtt);
+
     try {
       cRequestPacket vrp;
       vrp.init(VNSI_RECSTREAM_CLOSE);
@@ -95,38 +128,288 @@ int cVNSIRecording::Read(unsigned char* buf, uint32_t buf_size)
     return 1;
   }
 
+  // a recording still being written may have grown, never report the end
+  // from a length that is not fresh
   if (m_currentPlayingRecordPosition >= m_currentPlayingRecordBytes)
   {
-    GetLength();
+    GetLength(0);
     if (m_currentPlayingRecordPosition >= m_currentPlayingRecordBytes)
       return 0;
   }
 
-  cRequestPacket vrp;
-  vrp.init(VNSI_RECSTREAM_GETBLOCK);
-  vrp.add_U64(m_currentPlayingRecordPosition);
-  vrp.add_U32(buf_size);
+  // rest of a block that did not fit last time
+  if (m_partial)
+  {
+    if (m_partialPosition == m_currentPlayingRecordPosition)
+    {
+      uint32_t length = std::min((uint32_t)m_partial->getUserDataLength() - m_partialOffset, buf_size);
+      memcpy(buf, m_partial->getUserData() + m_partialOffset, length);
+      m_partialOffset += length;
+      m_partialPosition += length;
+      m_currentPlayingRecordPosition += length;
+      if (m_partialOffset >= m_partial->getUserDataLength())
+        m_partial.reset();
+      return length;
+    }
+    m_partial.reset();
+  }
+
+  // jumps back to data read before need no server round trip
+  size_t cached = m_cache.Read(m_recordingId, m_currentPlayingRecordPosition, buf, buf_size);
+  if (cached > 0)
+  {
+    m_currentPlayingRecordPosition += cached;
+    SkipReadAhead();
+    return cached;
+  }
+
+  // a seek or a short block leaves the requests in flight behind, their
+  // replies get dropped when they come in. Reading on inside the first
+  // block, e.g. after the cache served its start, keeps the pipeline
+  SkipReadAhead();
+  if (!m_readAhead.empty() && m_readAhead.front().position > m_currentPlayingRecordPosition)
+    ClearReadAhead();
+
+  if (m_readAhead.empty())
+    m_readAheadPosition = m_currentPlayingRecordPosition;
+
+  if (!SendReadAhead(m_chunkSize))
+    return -1;
+
+  SReadAhead block = std::move(m_readAhead.front());
+  m_readAhead.pop_front();
+  uint32_t skip = (uint32_t)(m_currentPlayingRecordPosition - block.position);
+
+  // unless the block came in early, is larger than buf or starts before
+  // the read position it goes from the socket right into buf
+  std::unique_ptr<cResponsePacket> vresp;
+  int64_t waitStart = GetTimeMs();
+  bool early = block.response != nullptr;
+  if (early)
+    vresp = std::move(block.response);
+  else if (skip == 0 && block.size <= buf_size)
+    vresp = ReadReply(block.serial, buf, buf_size);
+  else
+    vresp = ReadReply(block.serial);
+  int waited = (int)(GetTimeMs() - waitStart);
 
-  auto vresp = ReadResult(&vrp);
   if (!vresp)
+  {
+    ClearReadAhead();
     return -1;
+  }
 
-  uint32_t length = vresp->getUserDataLength();
-  uint8_t *data   = vresp->getUserData();
-  if (length > buf_size)
+  uint32_t received = vresp->getUserDataLength();
+  if (received > block.size)
   {
     XBMC->Log(LOG_ERROR, "%s: PANIC - Received more bytes as requested", __FUNCTION__);
+    ClearReadAhead();
     return 0;
   }
 
-  memcpy(buf, data, length);
+  // a reply that came in early has no arrival time, and one requested
+  // behind others waited in the pipeline, only the rest show the round trip
+  AdaptChunkSize(block.sent, block.headOfLine && !early, received, waited);
+
+  uint32_t length = received;
+  if (vresp->noResponse())
+    m_cache.Add(m_recordingId, block.position, buf, length);
+  else
+  {
+    m_cache.Add(m_recordingId, block.position, vresp->getUserData(), received);
+
+    // a short block that ends before the read position, ask again from there
+    if (skip > 0 && received <= skip)
+    {
+      ClearReadAhead();
+      return Read(buf, buf_size);
+    }
+
+    length = received - skip;
+    if (length > buf_size)
+      length = buf_size;
+    memcpy(buf, vresp->getUserData() + skip, length);
+    if (skip + length < received)
+    {
+      m_partialOffset = skip + length;
+      m_partialPosition = m_currentPlayingRecordPosition + length;
+      m_partial = std::move(vresp);
+    }
+  }
   m_currentPlayingRecordPosition += length;
+
+  // the following requests were made for the wrong offsets
+  if (received < block.size)
+    ClearReadAhead();
+
   return length;
 }
 
+void cVNSIRecording::SkipReadAhead()
+{
+  // blocks the cache served entirely are not waited for. A reply that came
+  // in already goes to the cache, later ones get dropped on arrival
+  while (!m_readAhead.empty() &&
+         m_readAhead.front().position + m_readAhead.front().size <= m_currentPlayingRecordPosition)
+  {
+    SReadAhead &block = m_readAhead.front();
+    if (block.response)
+      m_cache.Add(m_recordingId, block.position, block.response->getUserData(), block.response->getUserDataLength());
+    m_readAhead.pop_front();
+  }
+}
+
+void cVNSIRecording::AdaptChunkSize(int64_t sent, bool timed, uint32_t bytes, int waited)
+{
+  int64_t now = GetTimeMs();
+
+  // shortest request time as the round trip. Longer samples pull it up
+  // slowly, as a moving average rounded to nearest, so a changed route
+  // shows up again
+  if (timed)
+  {
+    int elapsed = (int)(now - sent);
+    if (m_rtt < 0 || elapsed < m_rtt)
+      m_rtt = elapsed;
+    else
+      m_rtt = (m_rtt * 15 + elapsed + 8) / 16;
+  }
+
+  // the player starved if it waited for a good part of a round trip, the
+  // requests ahead did not cover it then. A millisecond is timer noise
+  int threshold = m_rtt / 2 > kMinStarveTime ? m_rtt / 2 : kMinStarveTime;
+  bool starved = waited >= threshold;
+
+  // goodput over the time the link was busy with this block, it may have
+  // been queued behind the previous one
+  int64_t busy = now - std::max(sent, m_lastReply);
+  if (busy < 1)
+    busy = 1;
+  uint64_t rate = (uint64_t)bytes * 1000 / busy;
+  m_goodput = m_goodput ? (uint32_t)((m_goodput * 7ULL + rate) / 8) : (uint32_t)rate;
+  m_lastReply = now;
+
+  if (m_goodput == 0)
+    return;
+
+  // grow while the player waits for data and blocks are quick to transfer,
+  // shrink when a block takes long so seeks stay responsive on slow links
+  uint32_t size = m_chunkSize;
+  uint64_t blockTime = (uint64_t)size * 1000 / m_goodput;
+  if (starved && blockTime < kMaxBlockTime / 2 && size < kMaxChunkSize)
+    size = size * 2 < kMaxChunkSize ? size * 2 : kMaxChunkSize;
+  else if (blockTime > kMaxBlockTime && size > kMinChunkSize)
+    size = size / 2 > kMinChunkSize ? size / 2 : kMinChunkSize;
+
+  if (size != m_chunkSize)
+  {
+    XBMC->Log(LOG_DEBUG, "%s - block size %u -> %u KiB (goodput %u KiB/s, rtt %d ms)", __FUNCTION__,
+              m_chunkSize / 1024, size / 1024, m_goodput / 1024, m_rtt);
+    m_chunkSize = size;
+  }
+}
+
+cVNSIRecording::SChunkStats cVNSIRecording::GetChunkStats() const
+{
+  SChunkStats stats;
+  stats.chunkSize = m_chunkSize;
+  stats.goodput = m_goodput;
+  stats.rtt = m_rtt;
+  return stats;
+}
+
+bool cVNSIRecording::SendReadAhead(uint32_t size)
+{
+  // keep up to kReadAheadDepth blocks requested, but never beyond the
+  // known end of the recording. The new requests go out in one write
+  cRequestPacket vrp[kReadAheadDepth];
+  cRequestPacket* vrps[kReadAheadDepth];
+  size_t count = 0;
+
+  while (m_readAhead.size() + count < kReadAheadDepth &&
+         m_readAheadPosition < m_currentPlayingRecordBytes)
+  {
+    vrp[count].init(VNSI_RECSTREAM_GETBLOCK);
+    vrp[count].add_U64(m_readAheadPosition);
+    vrp[count].add_U32(size);
+    vrps[count] = &vrp[count];
+    count++;
+    m_readAheadPosition += size;
+  }
+
+  if (count == 0)
+    return true;
+
+  if (!TransmitMessages(vrps, count))
+  {
+    SignalConnectionLost();
+    ClearReadAhead();
+    return false;
+  }
+
+  int64_t now = GetTimeMs();
+  uint64_t position = m_readAheadPosition - (uint64_t)count * size;
+  for (size_t i = 0; i < count; i++)
+  {
+    SReadAhead block;
+    block.serial = vrp[i].getSerial();
+    block.position = position;
+    block.size = size;
+    block.sent = now;
+    block.headOfLine = m_readAhead.empty();
+    m_readAhead.push_back(std::move(block));
+    position += size;
+  }
+  return true;
+}
+
+void cVNSIRecording::ClearReadAhead()
+{
+  m_readAhead.clear();
+}
+
+std::unique_ptr<cResponsePacket> cVNSIRecording::ReadResult(cRequestPacket* vrp)
+{
+  if (!TransmitMessage(vrp))
+  {
+    SignalConnectionLost();
+    return nullptr;
+  }
+
+  return ReadReply(vrp->getSerial());
+}
+
+std::unique_ptr<cResponsePacket> cVNSIRecording::ReadReply(uint32_t serial, uint8_t* buffer, size_t size)
+{
+  std::unique_ptr<cResponsePacket> pkt;
+
+  while ((pkt = ReadMessage(10000, 10000, serial, buffer, size)))
+  {
+    if (pkt->getChannelID() != VNSI_CHANNEL_REQUEST_RESPONSE)
+      continue;
+
+    if (pkt->getRequestID() == serial)
+      return pkt;
+
+    // blocks read ahead are kept for the following Read() calls,
+    // replies to requests given up on are dropped
+    for (auto& block : m_readAhead)
+    {
+      if (block.serial == pkt->getRequestID())
+      {
+        block.response = std::move(pkt);
+        break;
+      }
+    }
+  }
+
+  SignalConnectionLost();
+  return nullptr;
+}
+
 bool cVNSIRecording::GetStreamTimes(PVR_STREAM_TIMES *times)
 {
-  GetLength();
+  GetLength(kLengthTimesAge);
   if (m_currentPlayingRecordLengthMSec == 0)
     return false;
 
@@ -172,6 +455,9 @@ long long cVNSIRecording::Seek(long long pos, uint32_t whence)
     return 0;
   }
 
+  if (nextPos != m_currentPlayingRecordPosition)
+    ClearReadAhead();
+
   m_currentPlayingRecordPosition = nextPos;
 
   return m_currentPlayingRecordPosition;
@@ -187,8 +473,16 @@ void cVNSIRecording::OnReconnect()
   OpenRecording(m_recinfo);
 }
 
-void cVNSIRecording::GetLength()
+void cVNSIRecording::GetLength(int maxAge)
 {
+  uint32_t changes = s_changes;
+  int64_t now = GetTimeMs();
+  if (m_lengthTime && changes == m_lengthChanges && now - m_lengthTime < maxAge)
+    return;
+
+  m_lengthTime = now;
+  m_lengthChanges = changes;
+
   cRequestPacket vrp;
   vrp.init(VNSI_RECSTREAM_GETLENGTH);
 
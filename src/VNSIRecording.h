@@ -21,8 +21,13 @@
  */
 
 #include "VNSISession.h"
+#include "blockcache.h"
 #include "client.h"
 
+#include <atomic>
+#include <deque>
+#include <memory>
+
 class cVNSIRecording : public cVNSISession
 {
 public:
@@ -37,17 +42,78 @@ public:
   long long Seek(long long pos, uint32_t whence);
   long long Length(void);
   bool GetStreamTimes(PVR_STREAM_TIMES *times);
+  cBlockCache::SStats GetCacheStats() const { return m_cache.GetStats(); }
+
+  struct SChunkStats
+  {
+    uint32_t chunkSize;   ///< current GETBLOCK size in bytes
+    uint32_t goodput;     ///< bytes per second
+    int      rtt;         ///< ms, shortest recent request
+  };
+  SChunkStats GetChunkStats() const;
+
+  /*!
+   * Called on VNSI_STATUS_RECORDINGSCHANGE, the open recording asks for its
+   * length again with the next read at the end or the next time poll
+   */
+  static void RecordingsChanged() { s_changes++; }
 
 protected:
 
   void OnReconnect() override;
-  void GetLength();
+  std::unique_ptr<cResponsePacket> ReadResult(cRequestPacket* vrp) override;
+  void GetLength(int maxAge);
 
 private:
 
+  std::unique_ptr<cResponsePacket> ReadReply(uint32_t serial, uint8_t* buffer = nullptr, size_t size = 0);
+  bool SendReadAhead(uint32_t size);
+  void ClearReadAhead();
+  void SkipReadAhead();
+  void AdaptChunkSize(int64_t sent, bool timed, uint32_t bytes, int waited);
+
   PVR_RECORDING m_recinfo;
   uint64_t m_currentPlayingRecordBytes;
   uint64_t m_currentPlayingRecordLengthMSec;
   uint32_t m_currentPlayingRecordFrames;
   uint64_t m_currentPlayingRecordPosition;
+  uint32_t m_recordingId = 0;
+
+  // the length of a recording still being written is only asked for
+  // again once it is older than the caller accepts, or on a change.
+  // Read() at the end always asks
+  static const int kLengthTimesAge = 2000;   ///< ms, GetStreamTimes()
+  static std::atomic<uint32_t> s_changes;
+  int64_t m_lengthTime = 0;
+  uint32_t m_lengthChanges = 0;
+  cBlockCache m_cache;
+
+  // GETBLOCK requests in flight for the following ranges, oldest first
+  static const size_t kReadAheadDepth = 4;
+  struct SReadAhead
+  {
+    uint32_t serial;
+    uint64_t position;
+    uint32_t size;
+    int64_t sent;
+    bool headOfLine;                            ///< no other request was in flight when it was sent
+    std::unique_ptr<cResponsePacket> response;  ///< set if it came in while waiting for another reply
+  };
+  std::deque<SReadAhead> m_readAhead;
+  uint64_t m_readAheadPosition = 0;             ///< where the next request starts
+
+  // block larger than the caller's buffer, the rest is handed out next
+  std::unique_ptr<cResponsePacket> m_partial;
+  uint32_t m_partialOffset = 0;
+  uint64_t m_partialPosition = 0;
+
+  // GETBLOCK size follows the measured link, see AdaptChunkSize()
+  static const uint32_t kMinChunkSize = 16 * 1024;
+  static const uint32_t kMaxChunkSize = 1024 * 1024;
+  static const int kMaxBlockTime = 100;         ///< ms to transfer one block
+  static const int kMinStarveTime = 2;          ///< ms the player has to wait at least to count as starved
+  uint32_t m_chunkSize = 0;
+  uint32_t m_goodput = 0;
+  int m_rtt = -1;
+  int64_t m_lastReply = 0;
 };
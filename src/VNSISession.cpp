@@ -26,8 +26,10 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <vector>
 
 #include "responsepacket.h"
+#include "responsepool.h"
 #include "requestpacket.h"
 #include "vnsicommand.h"
 #include "tools.h"
@@ -47,6 +49,7 @@ cVNSISession::cVNSISession()
   : m_protocol(0)
   , m_socket(NULL)
   , m_connectionLost(false)
+  , m_responsePool(std::make_shared<cResponsePool>())
 {
   m_abort = false;
 }
@@ -58,14 +61,27 @@ cVNSISession::~cVNSISession()
 
 void cVNSISession::Close()
 {
+  // kick a reader blocked on the socket so we can get the read lock
+  m_wakeup.Signal();
+
+  CLockObject readLock(m_readMutex);
   CLockObject lock(m_mutex);
   if (IsOpen())
   {
     m_socket->Close();
   }
 
+  if (m_socket)
+  {
+    cResponsePool::SStats stats = m_responsePool->GetStats();
+    XBMC->Log(LOG_DEBUG, "%s - response pool: %llu hits, %llu misses, %llu oversized", __FUNCTION__,
+              (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.oversized);
+  }
+
   delete m_socket;
   m_socket = NULL;
+
+  m_wakeup.Clear();
 }
 
 bool cVNSISession::Open(const std::string& hostname, int port, const char *name)
@@ -75,7 +91,8 @@ bool cVNSISession::Open(const std::string& hostname, int port, const char *name)
   uint64_t iNow = GetTimeMs();
   uint64_t iTarget = iNow + g_iConnectTimeout * 1000;
   if (!m_socket)
-    m_socket = new CTcpConnection(hostname.c_str(), port);
+    m_socket = new cVNSISocket(hostname, port);
+  m_socket->SetProfile(m_socketProfile);
   while (!m_socket->IsOpen() && iNow < iTarget && !m_abort)
   {
     if (!m_socket->Open(iTarget - iNow))
@@ -89,6 +106,9 @@ bool cVNSISession::Open(const std::string& hostname, int port, const char *name)
     return false;
   }
 
+  XBMC->Log(LOG_DEBUG, "%s - connected %s (%s)", __FUNCTION__,
+            name ? name : m_name.c_str(), m_socket->GetOptions().c_str());
+
   // store connection data
   m_hostname = hostname;
   m_port = port;
@@ -116,8 +136,8 @@ bool cVNSISession::Login()
       vrp.add_String("XBMC Media Center");
     }
 
-    // read welcome
-    std::unique_ptr<cResponsePacket> vresp(ReadResult(&vrp));
+    // read welcome, directly as no receive thread is running yet
+    std::unique_ptr<cResponsePacket> vresp(cVNSISession::ReadResult(&vrp));
     if (!vresp)
       throw "failed to read greeting from server";
 
@@ -157,6 +177,12 @@ bool cVNSISession::Login()
 }
 
 std::unique_ptr<cResponsePacket> cVNSISession::ReadMessage(int iInitialTimeout /*= 10000*/, int iDatapacketTimeout /*= 10000*/)
+{
+  return ReadMessage(iInitialTimeout, iDatapacketTimeout, 0, nullptr, 0);
+}
+
+std::unique_ptr<cResponsePacket> cVNSISession::ReadMessage(int iInitialTimeout, int iDatapacketTimeout,
+                                                           uint32_t serial, uint8_t* buffer, size_t size)
 {
   uint32_t channelID = 0;
   uint32_t userDataLength = 0;
@@ -164,7 +190,12 @@ std::unique_ptr<cResponsePacket> cVNSISession::ReadMessage(int iInitialTimeout /
 
   cResponsePacket* vresp = nullptr;
 
-  if(!ReadData((uint8_t*)&channelID, sizeof(uint32_t), iInitialTimeout))
+  // one reader at a time, the socket buffer may hold the next message
+  CLockObject lock(m_readMutex);
+
+  // once the first bytes are in the rest of the message follows, even a
+  // non-blocking poll has to wait for it
+  if(!ReadData((uint8_t*)&channelID, sizeof(uint32_t), iInitialTimeout, iDatapacketTimeout))
     return nullptr;
 
   // Data was read
@@ -172,7 +203,7 @@ std::unique_ptr<cResponsePacket> cVNSISession::ReadMessage(int iInitialTimeout /
   channelID = ntohl(channelID);
   if (channelID == VNSI_CHANNEL_STREAM)
   {
-    vresp = new cResponsePacket();
+    vresp = new (*m_responsePool) cResponsePacket();
 
     if (!ReadData(vresp->getHeader(), vresp->getStreamHeaderLength(), iDatapacketTimeout))
     {
@@ -191,7 +222,10 @@ std::unique_ptr<cResponsePacket> cVNSISession::ReadMessage(int iInitialTimeout /
       if (userDataLength > 0)
       {
         if (!userData)
+        {
+          delete vresp;
           return nullptr;
+        }
         if (!ReadData(p->pData, userDataLength, iDatapacketTimeout))
         {
           PVR->FreeDemuxPacket(p);
@@ -204,12 +238,10 @@ std::unique_ptr<cResponsePacket> cVNSISession::ReadMessage(int iInitialTimeout /
     }
     else if (userDataLength > 0)
     {
-      userData = (uint8_t*)malloc(userDataLength);
-      if (!userData)
-        return nullptr;
+      userData = (uint8_t*)m_responsePool->Allocate(userDataLength);
       if (!ReadData(userData, userDataLength, iDatapacketTimeout))
       {
-        free(userData);
+        cResponsePool::Free(userData);
         delete vresp;
         XBMC->Log(LOG_ERROR, "%s - lost sync on channel stream (other) packet", __FUNCTION__);
         SignalConnectionLost();
@@ -220,10 +252,11 @@ std::unique_ptr<cResponsePacket> cVNSISession::ReadMessage(int iInitialTimeout /
   }
   else if (channelID == VNSI_CHANNEL_OSD)
   {
-    vresp = new cResponsePacket();
+    vresp = new (*m_responsePool) cResponsePacket();
 
     if (!ReadData(vresp->getHeader(), vresp->getOSDHeaderLength(), iDatapacketTimeout))
     {
+      delete vresp;
       XBMC->Log(LOG_ERROR, "%s - lost sync on osd packet", __FUNCTION__);
       SignalConnectionLost();
       return NULL;
@@ -234,12 +267,10 @@ std::unique_ptr<cResponsePacket> cVNSISession::ReadMessage(int iInitialTimeout /
     userData = NULL;
     if (userDataLength > 0)
     {
-      userData = (uint8_t*)malloc(userDataLength);
-      if (!userData)
-        return nullptr;
+      userData = (uint8_t*)m_responsePool->Allocate(userDataLength);
       if (!ReadData(userData, userDataLength, iDatapacketTimeout))
       {
-        free(userData);
+        cResponsePool::Free(userData);
         delete vresp;
         XBMC->Log(LOG_ERROR, "%s - lost sync on additional osd packet", __FUNCTION__);
         SignalConnectionLost();
@@ -250,7 +281,7 @@ std::unique_ptr<cResponsePacket> cVNSISession::ReadMessage(int iInitialTimeout /
   }
   else
   {
-    vresp = new cResponsePacket();
+    vresp = new (*m_responsePool) cResponsePacket();
 
     if (!ReadData(vresp->getHeader(), vresp->getHeaderLength(), iDatapacketTimeout))
     {
@@ -263,14 +294,24 @@ std::unique_ptr<cResponsePacket> cVNSISession::ReadMessage(int iInitialTimeout /
     userDataLength = vresp->getUserDataLength();
 
     userData = NULL;
-    if (userDataLength > 0)
+    if (buffer && channelID == VNSI_CHANNEL_REQUEST_RESPONSE &&
+        vresp->getRequestID() == serial && userDataLength <= size)
     {
-      userData = (uint8_t*)malloc(userDataLength);
-      if (!userData)
-        return nullptr;
+      // the caller's buffer, no copy
+      if (userDataLength > 0 && !ReadData(buffer, userDataLength, iDatapacketTimeout))
+      {
+        delete vresp;
+        XBMC->Log(LOG_ERROR, "%s - lost sync on additional response packet", __FUNCTION__);
+        SignalConnectionLost();
+        return NULL;
+      }
+    }
+    else if (userDataLength > 0)
+    {
+      userData = (uint8_t*)m_responsePool->Allocate(userDataLength);
       if (!ReadData(userData, userDataLength, iDatapacketTimeout))
       {
-        free(userData);
+        cResponsePool::Free(userData);
         delete vresp;
         XBMC->Log(LOG_ERROR, "%s - lost sync on additional response packet", __FUNCTION__);
         SignalConnectionLost();
@@ -303,6 +344,28 @@ bool cVNSISession::TransmitMessage(cRequestPacket* vrp)
   return true;
 }
 
+bool cVNSISession::TransmitMessages(cRequestPacket* const vrps[], size_t count)
+{
+  CLockObject lock(m_mutex);
+
+  if (!IsOpen())
+    return false;
+
+  std::vector<cVNSISocket::Buffer> buffers(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    buffers[i].data = vrps[i]->getPtr();
+    buffers[i].len = vrps[i]->getLen();
+  }
+
+  if (!m_socket->Write(buffers.data(), count))
+  {
+    XBMC->Log(LOG_ERROR, "%s - Failed to write %d packets (%s)", __FUNCTION__, (int)count, m_socket->GetError().c_str());
+    return false;
+  }
+  return true;
+}
+
 std::unique_ptr<cResponsePacket> cVNSISession::ReadResult(cRequestPacket* vrp)
 {
   if (!TransmitMessage(vrp))
@@ -311,6 +374,11 @@ std::unique_ptr<cResponsePacket> cVNSISession::ReadResult(cRequestPacket* vrp)
     return nullptr;
   }
 
+  return ReadResponse(vrp);
+}
+
+std::unique_ptr<cResponsePacket> cVNSISession::ReadResponse(cRequestPacket* vrp)
+{
   std::unique_ptr<cResponsePacket> pkt;
 
   while ((pkt = ReadMessage(10000, 10000)))
@@ -367,12 +435,23 @@ cVNSISession::eCONNECTIONSTATE cVNSISession::TryReconnect()
   return CONN_ESABLISHED;
 }
 
+cResponsePool::SStats cVNSISession::GetResponsePoolStats()
+{
+  return m_responsePool->GetStats();
+}
+
 bool cVNSISession::IsOpen()
 {
   CLockObject lock(m_mutex);
   return m_socket && m_socket->IsOpen();
 }
 
+bool cVNSISession::ProbeSocket()
+{
+  CLockObject lock(m_mutex);
+  return m_socket && m_socket->IsAlive();
+}
+
 void cVNSISession::SignalConnectionLost()
 {
   if(m_connectionLost)
@@ -386,15 +465,21 @@ void cVNSISession::SignalConnectionLost()
   OnDisconnect();
 }
 
-bool cVNSISession::ReadData(uint8_t* buffer, int totalBytes, int timeout)
+bool cVNSISession::ReadData(uint8_t* buffer, int totalBytes, int timeout, int restTimeout)
 {
-  int bytesRead = m_socket->Read(buffer, totalBytes, timeout);
+  if (restTimeout < 0)
+    restTimeout = timeout;
+
+  if (!m_socket)
+    return false;
+
+  int bytesRead = m_socket->Read(buffer, totalBytes, timeout, &m_wakeup);
   if (bytesRead == totalBytes)
     return true;
   else if (m_socket->GetErrorNumber() == ETIMEDOUT && bytesRead > 0)
   {
     // we did read something. try to finish the read
-    bytesRead += m_socket->Read(buffer+bytesRead, totalBytes-bytesRead, timeout);
+    bytesRead += m_socket->Read(buffer+bytesRead, totalBytes-bytesRead, restTimeout, &m_wakeup);
     if (bytesRead == totalBytes)
       return true;
   }
@@ -24,17 +24,14 @@
 #include <string>
 #include <atomic>
 #include "p8-platform/threads/threads.h"
+#include "VNSISocket.h"
+#include "responsepool.h"
 
 #include <memory>
 
 class cResponsePacket;
 class cRequestPacket;
 
-namespace P8PLATFORM
-{
-  class CTcpConnection;
-}
-
 class cVNSISession
 {
 public:
@@ -47,6 +44,7 @@ public:
   int GetProtocol() const { return m_protocol; }
   const std::string& GetServerName() const { return m_server; }
   const std::string& GetVersion() const { return m_version; }
+  cResponsePool::SStats GetResponsePoolStats();
 
   enum eCONNECTIONSTATE
   {
@@ -61,13 +59,35 @@ protected:
   virtual bool Login();
 
   std::unique_ptr<cResponsePacket> ReadMessage(int iInitialTimeout, int iDatapacketTimeout);
+
+  /*!
+   * ReadMessage() that reads the payload of the response to serial straight
+   * into buffer, if the header says it fits. The returned packet then has
+   * no user data of its own, getUserDataLength() tells how much was stored.
+   */
+  std::unique_ptr<cResponsePacket> ReadMessage(int iInitialTimeout, int iDatapacketTimeout,
+                                               uint32_t serial, uint8_t* buffer, size_t size);
   bool TransmitMessage(cRequestPacket* vrp);
-  std::unique_ptr<cResponsePacket> ReadResult(cRequestPacket* vrp);
+  bool TransmitMessages(cRequestPacket* const vrps[], size_t count);
+  virtual std::unique_ptr<cResponsePacket> ReadResult(cRequestPacket* vrp);
+  std::unique_ptr<cResponsePacket> ReadResponse(cRequestPacket* vrp);
   bool ReadSuccess(cRequestPacket* m);
   void SleepMs(int ms);
 
+  /*!
+   * Socket tuning for this session, takes effect with the next Open()
+   */
+  void SetSocketProfile(cVNSISocket::eProfile profile) { m_socketProfile = profile; }
+
+  /*!
+   * Bytes already received from the server but not yet read, a following
+   * ReadMessage() will not block on the socket while this is non zero
+   */
+  size_t GetBuffered() const { return m_socket ? m_socket->GetBuffered() : 0; }
+
   eCONNECTIONSTATE TryReconnect();
   bool IsOpen();
+  bool ProbeSocket();
   virtual void OnDisconnect();
   virtual void OnReconnect();
   virtual void SignalConnectionLost();
@@ -79,12 +99,16 @@ protected:
   int m_protocol;
   std::string m_server;
   std::string m_version;
-  bool m_connectionLost;
+  std::atomic_bool m_connectionLost;
   std::atomic_bool m_abort;
 
 private:
 
-  bool ReadData(uint8_t* buffer, int totalBytes, int timeout);
+  bool ReadData(uint8_t* buffer, int totalBytes, int timeout, int restTimeout = -1);
 
-  P8PLATFORM::CTcpConnection *m_socket;
+  cVNSISocket *m_socket;
+  cVNSISocket::eProfile m_socketProfile = cVNSISocket::PROFILE_REQUEST;
+  P8PLATFORM::CMutex m_readMutex;
+  cVNSIWakeup m_wakeup;
+  std::shared_ptr<cResponsePool> m_responsePool;
 };
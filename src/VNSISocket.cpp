@@ -0,0 +1,590 @@
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "VNSISocket.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "p8-platform/sockets/tcp.h"
+#include "p8-platform/util/timeutils.h"
+
+#ifndef TARGET_WINDOWS
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+#include <vector>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+using namespace P8PLATFORM;
+
+// expose the native handle so we can poll and recv without the
+// fill-the-whole-buffer semantics of CTcpSocket::Read
+class cVNSISocket::cTcpSocket : public CTcpSocket
+{
+public:
+  cTcpSocket(const std::string& hostname, uint16_t port)
+    : CTcpSocket(hostname, port)
+  {
+  }
+
+  tcp_socket_t GetHandle() const { return m_socket; }
+};
+
+cVNSIWakeup::cVNSIWakeup()
+{
+  m_fd[0] = m_fd[1] = INVALID_SOCKET_VALUE;
+
+#if defined(__linux__)
+  m_fd[0] = m_fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#elif defined(TARGET_WINDOWS)
+  // a datagram socket connected to its own address, Signal() sends to
+  // itself and the reader's select() sees it readable
+  tcp_socket_t fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (fd == INVALID_SOCKET_VALUE)
+    return;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int len = sizeof(addr);
+  u_long nonblock = 1;
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+      getsockname(fd, (struct sockaddr*)&addr, &len) == 0 &&
+      connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+      ioctlsocket(fd, FIONBIO, &nonblock) == 0)
+    m_fd[0] = m_fd[1] = fd;
+  else
+    closesocket(fd);
+#else
+  if (pipe(m_fd) == 0)
+  {
+    fcntl(m_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(m_fd[1], F_SETFL, O_NONBLOCK);
+  }
+  else
+    m_fd[0] = m_fd[1] = INVALID_SOCKET_VALUE;
+#endif
+}
+
+cVNSIWakeup::~cVNSIWakeup()
+{
+#ifdef TARGET_WINDOWS
+  if (m_fd[0] != INVALID_SOCKET_VALUE)
+    closesocket(m_fd[0]);
+#else
+  if (m_fd[0] >= 0)
+    close(m_fd[0]);
+  if (m_fd[1] >= 0 && m_fd[1] != m_fd[0])
+    close(m_fd[1]);
+#endif
+}
+
+void cVNSIWakeup::Signal()
+{
+#if defined(__linux__)
+  uint64_t one = 1;
+  if (m_fd[1] >= 0 && write(m_fd[1], &one, sizeof(one)) < 0)
+    return;
+#elif defined(TARGET_WINDOWS)
+  char one = 1;
+  if (m_fd[1] != INVALID_SOCKET_VALUE)
+    send(m_fd[1], &one, sizeof(one), 0);
+#else
+  char one = 1;
+  if (m_fd[1] >= 0 && write(m_fd[1], &one, sizeof(one)) < 0)
+    return;
+#endif
+}
+
+void cVNSIWakeup::Clear()
+{
+#ifdef TARGET_WINDOWS
+  char buf[64];
+  while (m_fd[0] != INVALID_SOCKET_VALUE && recv(m_fd[0], buf, sizeof(buf), 0) > 0)
+    ;
+#else
+  uint8_t buf[64];
+  while (m_fd[0] >= 0 && read(m_fd[0], buf, sizeof(buf)) > 0)
+    ;
+#endif
+}
+
+// error of the last failed socket call as an errno value. Winsock does
+// not set errno, its codes that we act on are mapped, others kept as is
+static int SocketError()
+{
+#ifdef TARGET_WINDOWS
+  int error = WSAGetLastError();
+  switch (error)
+  {
+  case WSAEWOULDBLOCK:
+    return EAGAIN;
+  case WSAEINTR:
+    return EINTR;
+  case WSAECONNRESET:
+  case WSAECONNABORTED:
+    return ECONNRESET;
+  case WSAENOTCONN:
+    return ENOTCONN;
+  case WSAETIMEDOUT:
+    return ETIMEDOUT;
+  default:
+    return error;
+  }
+#else
+  return errno;
+#endif
+}
+
+cVNSISocket::cVNSISocket(const std::string& hostname, int port)
+  : m_socket(new cTcpSocket(hostname, port))
+  , m_head(0)
+  , m_used(0)
+  , m_error(0)
+  , m_profile(PROFILE_REQUEST)
+{
+}
+
+cVNSISocket::~cVNSISocket()
+{
+  Close();
+}
+
+bool cVNSISocket::Open(uint64_t timeout)
+{
+  m_head = 0;
+  m_used = 0;
+  m_error = 0;
+  if (!m_socket->Open(timeout))
+    return false;
+
+  ApplyProfile();
+  return true;
+}
+
+void cVNSISocket::ApplyProfile()
+{
+  tcp_socket_t fd = m_socket->GetHandle();
+  int on = 1;
+
+  // requests are small and waited for, never hold them back. Gathered
+  // writes already put a batch of requests into a single segment
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+
+  QuickAck();
+}
+
+void cVNSISocket::QuickAck()
+{
+#ifdef TCP_QUICKACK
+  // acknowledge the reply right away instead of waiting to piggyback the
+  // ACK. The flag is not permanent, the kernel falls back to delayed ACKs
+  // on its own, so it is set again whenever a request went out
+  if (m_profile == PROFILE_REQUEST)
+  {
+    int on = 1;
+    setsockopt(m_socket->GetHandle(), IPPROTO_TCP, TCP_QUICKACK, (const char*)&on, sizeof(on));
+  }
+#endif
+}
+
+std::string cVNSISocket::GetOptions()
+{
+  if (!m_socket->IsOpen())
+    return "closed";
+
+  tcp_socket_t fd = m_socket->GetHandle();
+  int rcvbuf = 0;
+  int nodelay = 0;
+  int quickack = 0;
+  socklen_t len;
+
+  len = sizeof(rcvbuf);
+  getsockopt(fd, SOL_SOCKET, SO_RCVBUF, (char*)&rcvbuf, &len);
+  len = sizeof(nodelay);
+  getsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char*)&nodelay, &len);
+#ifdef TCP_QUICKACK
+  len = sizeof(quickack);
+  getsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, (char*)&quickack, &len);
+#endif
+
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%s, receive buffer %d KiB, nodelay %d, quickack %d",
+           m_profile == PROFILE_STREAM ? "stream" : "request",
+           rcvbuf / 1024, nodelay != 0, quickack != 0);
+  return buf;
+}
+
+void cVNSISocket::Close()
+{
+  if (m_socket->IsOpen())
+    m_socket->Close();
+
+  m_head = 0;
+  m_used = 0;
+}
+
+bool cVNSISocket::IsOpen()
+{
+  return m_socket->IsOpen();
+}
+
+bool cVNSISocket::IsAlive()
+{
+  if (!m_socket->IsOpen())
+    return false;
+  if (m_used > 0)
+    return true;
+
+  tcp_socket_t fd = m_socket->GetHandle();
+
+#ifdef TARGET_WINDOWS
+  fd_set set;
+  FD_ZERO(&set);
+  FD_SET(fd, &set);
+  struct timeval tv;
+  tv.tv_sec = 0;
+  tv.tv_usec = 0;
+  int ret = select(0, &set, nullptr, nullptr, &tv);
+#else
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int ret = poll(&pfd, 1, 0);
+#endif
+  if (ret < 0)
+    return SocketError() == EINTR;
+  if (ret == 0)
+    return true;
+
+  // readable, either data or the end of the connection
+  char c;
+  ret = recv(fd, &c, 1, MSG_PEEK);
+  if (ret > 0)
+    return true;
+  if (ret < 0)
+  {
+    int error = SocketError();
+    return error == EAGAIN || error == EINTR;
+  }
+  return false;
+}
+
+ssize_t cVNSISocket::Write(void* data, size_t len)
+{
+  m_error = 0;
+  ssize_t ret = m_socket->Write(data, len);
+  if (ret > 0)
+    QuickAck();
+  return ret;
+}
+
+bool cVNSISocket::Write(const Buffer* buffers, size_t count)
+{
+  m_error = 0;
+
+#ifdef TARGET_WINDOWS
+  for (size_t i = 0; i < count; i++)
+  {
+    if (m_socket->Write((void*)buffers[i].data, buffers[i].len) != (ssize_t)buffers[i].len)
+      return false;
+  }
+  QuickAck();
+  return true;
+#else
+  if (!m_socket->IsOpen())
+  {
+    m_error = ENOTCONN;
+    return false;
+  }
+
+  std::vector<struct iovec> iov(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    iov[i].iov_base = (void*)buffers[i].data;
+    iov[i].iov_len = buffers[i].len;
+  }
+
+  size_t first = 0;
+  while (first < count)
+  {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov[first];
+    msg.msg_iovlen = count - first;
+#ifdef IOV_MAX
+    if (msg.msg_iovlen > IOV_MAX)
+      msg.msg_iovlen = IOV_MAX;
+#endif
+
+#ifdef MSG_NOSIGNAL
+    ssize_t ret = sendmsg(m_socket->GetHandle(), &msg, MSG_NOSIGNAL);
+#else
+    ssize_t ret = sendmsg(m_socket->GetHandle(), &msg, 0);
+#endif
+    if (ret < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN && WaitWritable())
+        continue;
+      m_error = errno;
+      return false;
+    }
+
+    // skip what went out, a partial write continues inside an iovec
+    size_t sent = ret;
+    while (first < count && sent >= iov[first].iov_len)
+    {
+      sent -= iov[first].iov_len;
+      first++;
+    }
+    if (first < count)
+    {
+      iov[first].iov_base = (uint8_t*)iov[first].iov_base + sent;
+      iov[first].iov_len -= sent;
+    }
+  }
+  QuickAck();
+  return true;
+#endif
+}
+
+std::string cVNSISocket::GetError()
+{
+#ifdef TARGET_WINDOWS
+  if (m_error >= WSABASEERR)
+  {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "socket error %d", m_error);
+    return buf;
+  }
+#endif
+  if (m_error)
+    return strerror(m_error);
+
+  return m_socket->GetError();
+}
+
+int cVNSISocket::GetErrorNumber()
+{
+  if (m_error)
+    return m_error;
+
+  return m_socket->GetErrorNumber();
+}
+
+ssize_t cVNSISocket::Read(void* data, size_t len, int timeout, const cVNSIWakeup* wakeup)
+{
+  uint8_t* dst = (uint8_t*)data;
+  size_t done = 0;
+  int64_t target = GetTimeMs() + timeout;
+
+  m_error = 0;
+
+  done += Consume(dst, len);
+
+  while (done < len)
+  {
+    int remaining = (int)(target - GetTimeMs());
+    if (remaining < 0)
+      remaining = 0;
+
+    int ready = WaitReadable(remaining, wakeup);
+    if (ready < 0)
+      return -1;
+    else if (ready == 0)
+    {
+      if (remaining > 0 && !m_error)
+        continue;
+      m_error = ETIMEDOUT;
+      return done;
+    }
+
+    // large payloads go straight to the target, everything else is
+    // collected in the ring buffer so following messages come for free
+    if (len - done >= kDirectReadSize)
+    {
+      ssize_t ret = Receive(dst + done, len - done);
+      if (ret < 0)
+        return -1;
+      done += ret;
+    }
+    else
+    {
+      if (!Fill())
+        return -1;
+      done += Consume(dst + done, len - done);
+    }
+  }
+
+  return done;
+}
+
+int cVNSISocket::WaitReadable(int timeout, const cVNSIWakeup* wakeup)
+{
+  if (!m_socket->IsOpen())
+  {
+    m_error = ENOTCONN;
+    return -1;
+  }
+
+  tcp_socket_t fd = m_socket->GetHandle();
+
+#ifdef TARGET_WINDOWS
+  fd_set set;
+  FD_ZERO(&set);
+  FD_SET(fd, &set);
+  bool wake = wakeup && wakeup->GetHandle() != INVALID_SOCKET_VALUE;
+  if (wake)
+    FD_SET(wakeup->GetHandle(), &set);
+  struct timeval tv;
+  tv.tv_sec = timeout / 1000;
+  tv.tv_usec = (timeout % 1000) * 1000;
+  int ret = select(0, &set, nullptr, nullptr, &tv);
+
+  // woken up from another thread, report it like a timeout
+  if (ret > 0 && wake && FD_ISSET(wakeup->GetHandle(), &set) && !FD_ISSET(fd, &set))
+  {
+    m_error = ETIMEDOUT;
+    return 0;
+  }
+#else
+  struct pollfd pfd[2];
+  nfds_t count = 1;
+  pfd[0].fd = fd;
+  pfd[0].events = POLLIN;
+  pfd[0].revents = 0;
+  if (wakeup && wakeup->GetHandle() != INVALID_SOCKET_VALUE)
+  {
+    pfd[1].fd = wakeup->GetHandle();
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+    count++;
+  }
+  int ret = poll(pfd, count, timeout);
+  if (ret < 0 && SocketError() == EINTR)
+    return 0;
+
+  // woken up from another thread, report it like a timeout
+  if (ret > 0 && count > 1 && (pfd[1].revents & POLLIN) && !(pfd[0].revents & POLLIN))
+  {
+    m_error = ETIMEDOUT;
+    return 0;
+  }
+#endif
+
+  if (ret < 0)
+  {
+    m_error = SocketError();
+    return -1;
+  }
+  return ret > 0 ? 1 : 0;
+}
+
+#ifndef TARGET_WINDOWS
+bool cVNSISocket::WaitWritable()
+{
+  struct pollfd pfd;
+  pfd.fd = m_socket->GetHandle();
+  pfd.events = POLLOUT;
+  pfd.revents = 0;
+  return poll(&pfd, 1, kWriteTimeout) > 0;
+}
+#endif
+
+ssize_t cVNSISocket::Receive(void* data, size_t len)
+{
+  ssize_t ret = recv(m_socket->GetHandle(), (char*)data, len, 0);
+  if (ret == 0)
+  {
+    m_error = ECONNRESET;
+    return -1;
+  }
+  else if (ret < 0)
+  {
+    int error = SocketError();
+    if (error == EAGAIN || error == EINTR)
+      return 0;
+    m_error = error;
+    return -1;
+  }
+
+  return ret;
+}
+
+bool cVNSISocket::Fill()
+{
+  size_t tail = (m_head + m_used) % kBufferSize;
+  size_t space = kBufferSize - m_used;
+
+  // only the contiguous part up to the end of the ring, the next fill
+  // picks up the wrapped remainder
+  if (tail + space > kBufferSize)
+    space = kBufferSize - tail;
+
+  if (space == 0)
+    return true;
+
+  ssize_t ret = Receive(m_buffer + tail, space);
+  if (ret < 0)
+    return false;
+
+  m_used += ret;
+  return true;
+}
+
+size_t cVNSISocket::Consume(uint8_t* data, size_t len)
+{
+  size_t done = 0;
+
+  while (done < len && m_used > 0)
+  {
+    size_t chunk = len - done;
+    if (chunk > m_used)
+      chunk = m_used;
+    if (m_head + chunk > kBufferSize)
+      chunk = kBufferSize - m_head;
+
+    memcpy(data + done, m_buffer + m_head, chunk);
+    done += chunk;
+    m_used -= chunk;
+    m_head = (m_head + chunk) % kBufferSize;
+  }
+
+  // restart at the front while empty to keep fills contiguous
+  if (m_used == 0)
+    m_head = 0;
+
+  return done;
+}
@@ -0,0 +1,153 @@
+#pragma once
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <string>
+#include <memory>
+#include "p8-platform/os.h"
+
+/*!
+ * Wakes up a reader blocked in cVNSISocket::Read, e.g. when the session
+ * gets closed from another thread. Backed by an eventfd on Linux, a pipe
+ * on other POSIX systems and a loopback UDP socket on Windows, where
+ * select() only takes sockets.
+ */
+class cVNSIWakeup
+{
+public:
+
+  cVNSIWakeup();
+  ~cVNSIWakeup();
+
+  void Signal();
+  void Clear();
+  tcp_socket_t GetHandle() const { return m_fd[0]; }
+
+private:
+
+  tcp_socket_t m_fd[2];
+};
+
+/*!
+ * TCP connection to the VNSI server with a userspace receive buffer.
+ *
+ * Reads are served from a ring buffer that is refilled with one large recv,
+ * so the channel id, header and payload of many small messages cost a single
+ * syscall. Reads that are larger than kDirectReadSize bypass the buffer and
+ * land straight in the caller's memory (e.g. DemuxPacket::pData).
+ *
+ * The class does no locking itself, the owning session serializes readers
+ * and writers.
+ */
+class cVNSISocket
+{
+public:
+
+  cVNSISocket(const std::string& hostname, int port);
+  ~cVNSISocket();
+
+  /*!
+   * Socket options applied on Open().
+   * PROFILE_REQUEST: small request/response traffic, no Nagle, quick ACK
+   * re-armed with every request so the reply is acknowledged at once
+   * PROFILE_STREAM: bulk transfer to the client, no Nagle. The receive
+   * buffer is left to the kernel's autotuning, setting SO_RCVBUF would
+   * switch that off
+   */
+  enum eProfile
+  {
+    PROFILE_REQUEST = 0,
+    PROFILE_STREAM
+  };
+
+  void SetProfile(eProfile profile) { m_profile = profile; }
+
+  /*!
+   * Effective socket options as reported by the system, for the log
+   */
+  std::string GetOptions();
+
+  bool Open(uint64_t timeout);
+  void Close();
+  bool IsOpen();
+
+  /*!
+   * Non-blocking check of an idle connection, false if the server closed
+   * it or it failed meanwhile. Nothing is consumed.
+   */
+  bool IsAlive();
+
+  ssize_t Write(void* data, size_t len);
+
+  struct Buffer
+  {
+    const void* data;
+    size_t len;
+  };
+
+  /*!
+   * Gathered write of count buffers, a single sendmsg where supported.
+   * Returns true if all bytes were written.
+   */
+  bool Write(const Buffer* buffers, size_t count);
+
+  /*!
+   * Read exactly len bytes unless timeout (ms) expires, the wakeup gets
+   * signaled or the connection fails. Returns the number of bytes read, or
+   * -1 on a connection error. GetErrorNumber() is ETIMEDOUT if the read was
+   * cut short by the timeout or the wakeup.
+   */
+  ssize_t Read(void* data, size_t len, int timeout, const cVNSIWakeup* wakeup = nullptr);
+
+  std::string GetError();
+  int GetErrorNumber();
+
+  /*!
+   * Number of bytes already received but not yet consumed
+   */
+  size_t GetBuffered() const { return m_used; }
+
+private:
+
+  static const size_t kBufferSize = 64 * 1024;
+  static const size_t kDirectReadSize = 8 * 1024;
+  static const int kWriteTimeout = 10000;
+
+  int WaitReadable(int timeout, const cVNSIWakeup* wakeup);
+  bool WaitWritable();
+  ssize_t Receive(void* data, size_t len);
+  bool Fill();
+  size_t Consume(uint8_t* data, size_t len);
+  void ApplyProfile();
+  void QuickAck();
+
+  class cTcpSocket;
+  std::unique_ptr<cTcpSocket> m_socket;
+
+  uint8_t m_buffer[kBufferSize];
+  size_t m_head;
+  size_t m_used;
+  int m_error;
+  eProfile m_profile;
+};
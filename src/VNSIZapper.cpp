@@ -0,0 +1,169 @@
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <string.h>
+#include "VNSIZapper.h"
+#include "VNSIDemux.h"
+#include "client.h"
+
+using namespace ADDON;
+using namespace P8PLATFORM;
+
+cVNSIZapper::cVNSIZapper()
+  : m_sessions(0)
+{
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+cVNSIZapper::~cVNSIZapper()
+{
+  Stop();
+}
+
+void cVNSIZapper::SetSessions(int sessions)
+{
+  if (sessions < 0)
+    sessions = 0;
+
+  {
+    CLockObject lock(m_mutex);
+    m_sessions = sessions;
+  }
+
+  if (sessions == 0)
+    Stop();
+  else if (!IsRunning())
+    CreateThread();
+  else
+    m_event.Signal();
+}
+
+void cVNSIZapper::Stop()
+{
+  StopThread(-1);
+  m_event.Signal();
+  StopThread();
+
+  // closing a session talks to the server, not while holding the lock
+  std::deque<cVNSIDemux*> standby;
+  {
+    CLockObject lock(m_mutex);
+    standby.swap(m_standby);
+  }
+  for (auto demux : standby)
+    delete demux;
+}
+
+cVNSIDemux* cVNSIZapper::Acquire()
+{
+  cVNSIDemux *demux = nullptr;
+  while (!demux)
+  {
+    {
+      CLockObject lock(m_mutex);
+      if (m_standby.empty())
+        break;
+      demux = m_standby.front();
+      m_standby.pop_front();
+    }
+
+    // the server may have dropped an idle session meanwhile
+    if (!demux->IsAlive())
+    {
+      delete demux;
+      demux = nullptr;
+    }
+  }
+
+  // have the next one ready for the following switch
+  m_event.Signal();
+  return demux;
+}
+
+void cVNSIZapper::ReportZap(bool warm, int ms)
+{
+  CLockObject lock(m_mutex);
+  if (warm)
+  {
+    m_stats.warmZaps++;
+    m_stats.warmMs += ms;
+  }
+  else
+  {
+    m_stats.coldZaps++;
+    m_stats.coldMs += ms;
+  }
+
+  XBMC->Log(LOG_DEBUG, "%s - %s zap took %d ms, mean cold %d ms (%u), warm %d ms (%u)", __FUNCTION__,
+            warm ? "warm" : "cold", ms,
+            m_stats.coldZaps ? (int)(m_stats.coldMs / m_stats.coldZaps) : 0, m_stats.coldZaps,
+            m_stats.warmZaps ? (int)(m_stats.warmMs / m_stats.warmZaps) : 0, m_stats.warmZaps);
+}
+
+void *cVNSIZapper::Process()
+{
+  while (!IsStopped())
+  {
+    size_t missing = 0;
+    std::deque<cVNSIDemux*> surplus;
+    {
+      CLockObject lock(m_mutex);
+      if ((int)m_standby.size() < m_sessions)
+        missing = m_sessions - m_standby.size();
+      while ((int)m_standby.size() > m_sessions)
+      {
+        surplus.push_back(m_standby.back());
+        m_standby.pop_back();
+      }
+    }
+    for (auto demux : surplus)
+      delete demux;
+
+    bool failed = false;
+    while (missing-- > 0 && !IsStopped())
+    {
+      cVNSIDemux *demux = new cVNSIDemux;
+      bool connected = false;
+      try
+      {
+        connected = demux->Connect();
+      }
+      catch (const std::exception &e)
+      {
+        XBMC->Log(LOG_ERROR, "%s - %s", __FUNCTION__, e.what());
+      }
+      if (!connected)
+      {
+        delete demux;
+        failed = true;
+        break;
+      }
+
+      CLockObject lock(m_mutex);
+      m_standby.push_back(demux);
+    }
+
+    // retry less eagerly while the server is unreachable
+    m_event.Wait(failed ? 10000 : 60000);
+  }
+
+  return NULL;
+}
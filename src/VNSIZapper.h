@@ -0,0 +1,71 @@
+#pragma once
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stdint.h>
+#include <deque>
+#include "p8-platform/threads/threads.h"
+
+class cVNSIDemux;
+
+struct SZapStats
+{
+  uint32_t coldZaps;
+  uint32_t warmZaps;
+  uint64_t coldMs;    ///< summed zap times, divide by the count for the mean
+  uint64_t warmMs;
+};
+
+/*!
+ * Keeps connected and logged in demux sessions in reserve, so a channel
+ * switch only has to open the channel stream.
+ */
+class cVNSIZapper : public P8PLATFORM::CThread
+{
+public:
+
+  cVNSIZapper();
+  virtual ~cVNSIZapper();
+
+  void SetSessions(int sessions);
+
+  /*!
+   * Take a standby session, nullptr if none is ready. The caller owns the
+   * returned demux.
+   */
+  cVNSIDemux* Acquire();
+
+  void ReportZap(bool warm, int ms);
+
+protected:
+
+  void *Process(void) override;
+
+private:
+
+  void Stop();
+
+  P8PLATFORM::CMutex m_mutex;
+  P8PLATFORM::CEvent m_event;
+  std::deque<cVNSIDemux*> m_standby;
+  int m_sessions;
+  SZapStats m_stats;
+};
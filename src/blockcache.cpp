@@ -0,0 +1,180 @@
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "blockcache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+cBlockCache::cBlockCache()
+  : m_capacity(0)
+  , m_hits(0)
+  , m_misses(0)
+{
+}
+
+cBlockCache::~cBlockCache()
+{
+  Clear();
+}
+
+void cBlockCache::SetCapacity(size_t bytes)
+{
+  // a budget below one block can't hold anything without exceeding it
+  m_capacity = bytes < kBlockSize ? 0 : bytes;
+  Evict(0);
+}
+
+void cBlockCache::Clear()
+{
+  for (auto &block : m_blocks)
+    free(block.data);
+
+  m_blocks.clear();
+  m_index.clear();
+}
+
+size_t cBlockCache::Read(uint32_t recording, uint64_t position, uint8_t *data, size_t size)
+{
+  if (!IsEnabled())
+    return 0;
+
+  size_t done = 0;
+
+  while (done < size)
+  {
+    uint64_t pos = position + done;
+    uint32_t offset = pos % kBlockSize;
+
+    auto it = m_index.find(Key(recording, pos - offset));
+    if (it == m_index.end())
+      break;
+
+    SBlock &block = *it->second;
+    if (offset < block.begin || offset >= block.end)
+      break;
+
+    size_t len = block.end - offset;
+    if (len > size - done)
+      len = size - done;
+    memcpy(data + done, block.data + offset, len);
+    done += len;
+
+    m_blocks.splice(m_blocks.begin(), m_blocks, it->second);
+
+    // a block known only in part ends the run
+    if (block.end < kBlockSize)
+      break;
+  }
+
+  if (done > 0)
+    m_hits++;
+  else
+    m_misses++;
+
+  return done;
+}
+
+void cBlockCache::Add(uint32_t recording, uint64_t position, const uint8_t *data, size_t size)
+{
+  if (!IsEnabled())
+    return;
+
+  while (size > 0)
+  {
+    uint32_t offset = position % kBlockSize;
+    uint32_t len = kBlockSize - offset;
+    if (len > size)
+      len = size;
+
+    Store(Key(recording, position - offset), offset, data, len);
+
+    position += len;
+    data += len;
+    size -= len;
+  }
+}
+
+void cBlockCache::Store(const Key &key, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+  uint32_t end = offset + size;
+
+  auto it = m_index.find(key);
+  if (it != m_index.end())
+  {
+    SBlock &block = *it->second;
+    memcpy(block.data + offset, data, size);
+
+    // grow the known range if the new data touches it, otherwise the
+    // new range replaces it
+    if (offset <= block.end && end >= block.begin)
+    {
+      if (offset < block.begin)
+        block.begin = offset;
+      if (end > block.end)
+        block.end = end;
+    }
+    else
+    {
+      block.begin = offset;
+      block.end = end;
+    }
+
+    m_blocks.splice(m_blocks.begin(), m_blocks, it->second);
+    return;
+  }
+
+  Evict(kBlockSize);
+
+  SBlock block;
+  block.key = key;
+  block.data = (uint8_t*)malloc(kBlockSize);
+  if (!block.data)
+    return;
+  block.begin = offset;
+  block.end = end;
+  memcpy(block.data + offset, data, size);
+
+  m_blocks.push_front(block);
+  m_index[key] = m_blocks.begin();
+}
+
+void cBlockCache::Evict(size_t bytes)
+{
+  // make room for bytes more
+  while (!m_blocks.empty() && m_blocks.size() * kBlockSize + bytes > m_capacity)
+  {
+    SBlock &block = m_blocks.back();
+    m_index.erase(block.key);
+    free(block.data);
+    m_blocks.pop_back();
+  }
+}
+
+cBlockCache::SStats cBlockCache::GetStats() const
+{
+  SStats stats;
+  stats.hits = m_hits;
+  stats.misses = m_misses;
+  stats.bytes = m_blocks.size() * kBlockSize;
+  stats.capacity = m_capacity;
+  return stats;
+}
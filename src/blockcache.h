@@ -0,0 +1,96 @@
+#pragma once
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <list>
+#include <map>
+#include <utility>
+
+/*!
+ * LRU cache of recording data in aligned blocks of kBlockSize bytes, keyed
+ * by recording id and block offset.
+ *
+ * Each block remembers the contiguous range of it that is known, so reads
+ * at any offset and of any size can be stored. Lookups return as much as
+ * is known from the given position to the end of that range.
+ */
+class cBlockCache
+{
+public:
+
+  struct SStats
+  {
+    uint64_t hits;        ///< reads served from the cache
+    uint64_t misses;      ///< reads passed on to the server
+    size_t   bytes;       ///< memory held by blocks
+    size_t   capacity;
+  };
+
+  static const size_t kBlockSize = 64 * 1024;
+
+  cBlockCache();
+  ~cBlockCache();
+
+  /*!
+   * Memory budget in bytes, 0 or less than kBlockSize disables the cache.
+   * Shrinking drops the least recently used blocks.
+   */
+  void SetCapacity(size_t bytes);
+  bool IsEnabled() const { return m_capacity > 0; }
+
+  void Clear();
+
+  /*!
+   * Copy up to size bytes at position into data, stops at the end of the
+   * known range. Returns the number of bytes copied, 0 is a miss.
+   */
+  size_t Read(uint32_t recording, uint64_t position, uint8_t *data, size_t size);
+
+  void Add(uint32_t recording, uint64_t position, const uint8_t *data, size_t size);
+
+  SStats GetStats() const;
+
+private:
+
+  typedef std::pair<uint32_t, uint64_t> Key;
+
+  struct SBlock
+  {
+    Key key;
+    uint8_t *data;
+    uint32_t begin;       ///< known range within the block
+    uint32_t end;
+  };
+
+  typedef std::list<SBlock> List;
+
+  void Store(const Key &key, uint32_t offset, const uint8_t *data, uint32_t size);
+  void Evict(size_t bytes);
+
+  List m_blocks;          ///< most recently used first
+  std::map<Key, List::iterator> m_index;
+  size_t m_capacity;
+
+  uint64_t m_hits;
+  uint64_t m_misses;
+};
@@ -22,12 +22,14 @@
 #include "client.h"
 #include "xbmc_pvr_dll.h"
 #include "VNSIDemux.h"
+#include "VNSIZapper.h"
 #include "VNSIRecording.h"
 #include "VNSIData.h"
 #include "VNSIChannelScan.h"
 #include "VNSIAdmin.h"
 #include "vnsicommand.h"
 #include "p8-platform/util/util.h"
+#include "p8-platform/util/timeutils.h"
 
 #include <sstream>
 #include <string>
@@ -53,6 +55,15 @@ bool          g_bAutoChannelGroups      = DEFAULT_AUTOGROUPS;
 int           g_iTimeshift              = 1;
 std::string   g_szIconPath              = "";
 int           g_iChunkSize              = DEFAULT_CHUNKSIZE;
+bool          g_bPrefetch               = DEFAULT_PREFETCH;
+int           g_iPrefetchPackets        = DEFAULT_PREFETCH_PKTS;
+int           g_iPrefetchKBytes         = DEFAULT_PREFETCH_KB;
+int           g_iStandbySessions        = DEFAULT_STANDBY;
+bool          g_bLiveBuffer             = DEFAULT_LIVEBUFFER;
+int           g_iLiveBufferMB           = DEFAULT_LIVEBUFFER_MB;
+std::string   g_szLiveBufferDir         = "";
+int           g_iLiveBufferDiskMB       = DEFAULT_LIVEBUFFER_DISK_MB;
+int           g_iRecCacheMB             = DEFAULT_RECCACHE_MB;
 
 int prioVals[] = {0,5,10,15,20,25,30,35,40,45,50,55,60,65,70,75,80,85,90,95,99,100};
 
@@ -61,6 +72,7 @@ CHelper_libKODI_guilib *GUI = nullptr;
 CHelper_libXBMC_pvr *PVR = nullptr;
 
 cVNSIDemux *VNSIDemuxer = nullptr;
+cVNSIZapper *VNSIZapper = nullptr;
 cVNSIData *VNSIData = nullptr;
 cVNSIRecording *VNSIRecording = nullptr;
 
@@ -208,6 +220,84 @@ ADDON_STATUS ADDON_Create(void* hdl, void* props)
     g_iChunkSize = DEFAULT_CHUNKSIZE;
   }
 
+  // Read setting "prefetch" from settings.xml
+  if (!XBMC->GetSetting("prefetch", &g_bPrefetch))
+  {
+    /* If setting is unknown fallback to defaults */
+    XBMC->Log(LOG_ERROR, "Couldn't get 'prefetch' setting, falling back to 'false' as default");
+    g_bPrefetch = DEFAULT_PREFETCH;
+  }
+
+  // Read setting "prefetchpackets" from settings.xml
+  if (!XBMC->GetSetting("prefetchpackets", &g_iPrefetchPackets))
+  {
+    /* If setting is unknown fallback to defaults */
+    XBMC->Log(LOG_ERROR, "Couldn't get 'prefetchpackets' setting, falling back to %i as default", DEFAULT_PREFETCH_PKTS);
+    g_iPrefetchPackets = DEFAULT_PREFETCH_PKTS;
+  }
+
+  // Read setting "prefetchkbytes" from settings.xml
+  if (!XBMC->GetSetting("prefetchkbytes", &g_iPrefetchKBytes))
+  {
+    /* If setting is unknown fallback to defaults */
+    XBMC->Log(LOG_ERROR, "Couldn't get 'prefetchkbytes' setting, falling back to %i as default", DEFAULT_PREFETCH_KB);
+    g_iPrefetchKBytes = DEFAULT_PREFETCH_KB;
+  }
+
+  // Read setting "standbysessions" from settings.xml
+  if (!XBMC->GetSetting("standbysessions", &g_iStandbySessions))
+  {
+    /* If setting is unknown fallback to defaults */
+    XBMC->Log(LOG_ERROR, "Couldn't get 'standbysessions' setting, falling back to %i as default", DEFAULT_STANDBY);
+    g_iStandbySessions = DEFAULT_STANDBY;
+  }
+
+  // Read setting "livebuffer" from settings.xml
+  if (!XBMC->GetSetting("livebuffer", &g_bLiveBuffer))
+  {
+    /* If setting is unknown fallback to defaults */
+    XBMC->Log(LOG_ERROR, "Couldn't get 'livebuffer' setting, falling back to 'false' as default");
+    g_bLiveBuffer = DEFAULT_LIVEBUFFER;
+  }
+
+  // Read setting "livebuffermb" from settings.xml
+  if (!XBMC->GetSetting("livebuffermb", &g_iLiveBufferMB))
+  {
+    /* If setting is unknown fallback to defaults */
+    XBMC->Log(LOG_ERROR, "Couldn't get 'livebuffermb' setting, falling back to %i as default", DEFAULT_LIVEBUFFER_MB);
+    g_iLiveBufferMB = DEFAULT_LIVEBUFFER_MB;
+  }
+
+  // Read setting "livebufferdir" from settings.xml
+  buffer = (char*) malloc(512);
+  buffer[0] = 0; /* Set the end of string */
+
+  if (XBMC->GetSetting("livebufferdir", buffer))
+    g_szLiveBufferDir = buffer;
+  else
+  {
+    // If setting is unknown fallback to defaults
+    XBMC->Log(LOG_ERROR, "Couldn't get 'livebufferdir' setting");
+    g_szLiveBufferDir = "";
+  }
+  free(buffer);
+
+  // Read setting "livebufferdiskmb" from settings.xml
+  if (!XBMC->GetSetting("livebufferdiskmb", &g_iLiveBufferDiskMB))
+  {
+    /* If setting is unknown fallback to defaults */
+    XBMC->Log(LOG_ERROR, "Couldn't get 'livebufferdiskmb' setting, falling back to %i as default", DEFAULT_LIVEBUFFER_DISK_MB);
+    g_iLiveBufferDiskMB = DEFAULT_LIVEBUFFER_DISK_MB;
+  }
+
+  // Read setting "recordingcachemb" from settings.xml
+  if (!XBMC->GetSetting("recordingcachemb", &g_iRecCacheMB))
+  {
+    /* If setting is unknown fallback to defaults */
+    XBMC->Log(LOG_ERROR, "Couldn't get 'recordingcachemb' setting, falling back to %i as default", DEFAULT_RECCACHE_MB);
+    g_iRecCacheMB = DEFAULT_RECCACHE_MB;
+  }
+
   try
   {
     VNSIData = new cVNSIData;
@@ -227,6 +317,9 @@ ADDON_STATUS ADDON_Create(void* hdl, void* props)
     return m_CurStatus;
   }
 
+  VNSIZapper = new cVNSIZapper;
+  VNSIZapper->SetSessions(g_iStandbySessions);
+
   PVR_MENUHOOK hook;
   hook.iHookId = 1;
   hook.category = PVR_MENUHOOK_SETTING;
@@ -246,6 +339,9 @@ void ADDON_Destroy()
   if (VNSIDemuxer)
     SAFE_DELETE(VNSIDemuxer);
 
+  if (VNSIZapper)
+    SAFE_DELETE(VNSIZapper);
+
   if (VNSIRecording)
     SAFE_DELETE(VNSIRecording);
 
@@ -330,6 +426,53 @@ ADDON_STATUS ADDON_SetSetting(const char *settingName, const void *settingValue)
     XBMC->Log(LOG_INFO, "Changed Setting 'chunksize' from %u to %u", g_iChunkSize, *(int*) settingValue);
     g_iChunkSize = *(int*) settingValue;
   }
+  else if (str == "prefetch")
+  {
+    XBMC->Log(LOG_INFO, "Changed Setting 'prefetch' from %u to %u", g_bPrefetch, *(bool*) settingValue);
+    g_bPrefetch = *(bool*) settingValue;
+  }
+  else if (str == "prefetchpackets")
+  {
+    XBMC->Log(LOG_INFO, "Changed Setting 'prefetchpackets' from %u to %u", g_iPrefetchPackets, *(int*) settingValue);
+    g_iPrefetchPackets = *(int*) settingValue;
+  }
+  else if (str == "prefetchkbytes")
+  {
+    XBMC->Log(LOG_INFO, "Changed Setting 'prefetchkbytes' from %u to %u", g_iPrefetchKBytes, *(int*) settingValue);
+    g_iPrefetchKBytes = *(int*) settingValue;
+  }
+  else if (str == "standbysessions")
+  {
+    XBMC->Log(LOG_INFO, "Changed Setting 'standbysessions' from %u to %u", g_iStandbySessions, *(int*) settingValue);
+    g_iStandbySessions = *(int*) settingValue;
+    if (VNSIZapper)
+      VNSIZapper->SetSessions(g_iStandbySessions);
+  }
+  else if (str == "livebuffer")
+  {
+    XBMC->Log(LOG_INFO, "Changed Setting 'livebuffer' from %u to %u", g_bLiveBuffer, *(bool*) settingValue);
+    g_bLiveBuffer = *(bool*) settingValue;
+  }
+  else if (str == "livebuffermb")
+  {
+    XBMC->Log(LOG_INFO, "Changed Setting 'livebuffermb' from %u to %u", g_iLiveBufferMB, *(int*) settingValue);
+    g_iLiveBufferMB = *(int*) settingValue;
+  }
+  else if (str == "livebufferdir")
+  {
+    XBMC->Log(LOG_INFO, "Changed Setting 'livebufferdir' from %s to %s", g_szLiveBufferDir.c_str(), (const char*) settingValue);
+    g_szLiveBufferDir = (const char*) settingValue;
+  }
+  else if (str == "livebufferdiskmb")
+  {
+    XBMC->Log(LOG_INFO, "Changed Setting 'livebufferdiskmb' from %u to %u", g_iLiveBufferDiskMB, *(int*) settingValue);
+    g_iLiveBufferDiskMB = *(int*) settingValue;
+  }
+  else if (str == "recordingcachemb")
+  {
+    XBMC->Log(LOG_INFO, "Changed Setting 'recordingcachemb' from %u to %u", g_iRecCacheMB, *(int*) settingValue);
+    g_iRecCacheMB = *(int*) settingValue;
+  }
 
   return ADDON_STATUS_OK;
 }
@@ -373,10 +516,15 @@ PVR_ERROR GetAddonCapabilities(PVR_ADDON_CAPABILITIES* pCapabilities)
   pCapabilities->bSupportsChannelGroups      = true;
   pCapabilities->bHandlesInputStream         = true;
   pCapabilities->bHandlesDemuxing            = true;
-  if (VNSIData && VNSIData->SupportChannelScan())
-    pCapabilities->bSupportsChannelScan      = true;
-  if (VNSIData && VNSIData->SupportRecordingsUndelete())
-    pCapabilities->bSupportsRecordingsUndelete = true;
+  if (VNSIData)
+  {
+    bool channelScan, recordingsUndelete;
+    VNSIData->GetSupportedFeatures(channelScan, recordingsUndelete);
+    if (channelScan)
+      pCapabilities->bSupportsChannelScan      = true;
+    if (recordingsUndelete)
+      pCapabilities->bSupportsRecordingsUndelete = true;
+  }
   pCapabilities->bSupportsRecordingsRename = true;
   pCapabilities->bSupportsRecordingsLifetimeChange = false;
   pCapabilities->bSupportsDescrambleInfo = false;
@@ -509,10 +657,7 @@ PVR_ERROR GetChannelGroups(ADDON_HANDLE handle, bool bRadio)
     return PVR_ERROR_SERVER_ERROR;
 
   try {
-    if(VNSIData->GetChannelGroupCount(g_bAutoChannelGroups) > 0)
-      return VNSIData->GetChannelGroupList(handle, bRadio) ? PVR_ERROR_NO_ERROR : PVR_ERROR_SERVER_ERROR;
-
-    return PVR_ERROR_NO_ERROR;
+    return VNSIData->GetChannelGroupList(handle, bRadio, g_bAutoChannelGroups) ? PVR_ERROR_NO_ERROR : PVR_ERROR_SERVER_ERROR;
   } catch (std::exception e) {
     XBMC->Log(LOG_ERROR, "%s - %s", __FUNCTION__, e.what());
     return PVR_ERROR_SERVER_ERROR;
@@ -725,18 +870,39 @@ PVR_ERROR DeleteAllRecordingsFromTrash()
 
 bool OpenLiveStream(const PVR_CHANNEL &channel)
 {
+  int64_t start = P8PLATFORM::GetTimeMs();
+
   CloseLiveStream();
 
   try
   {
-    VNSIDemuxer = new cVNSIDemux;
+    bool warm = false;
+    if (VNSIZapper && (VNSIDemuxer = VNSIZapper->Acquire()))
+    {
+      warm = true;
+      if (!VNSIDemuxer->OpenChannel(channel))
+      {
+        // standby session went stale, fall back to a new connection
+        delete VNSIDemuxer;
+        VNSIDemuxer = nullptr;
+        warm = false;
+      }
+    }
+
     IsRealtime = true;
-    if (!VNSIDemuxer->OpenChannel(channel)) {
-      delete VNSIDemuxer;
-      VNSIDemuxer = nullptr;
-      return false;
+    if (!VNSIDemuxer)
+    {
+      VNSIDemuxer = new cVNSIDemux;
+      if (!VNSIDemuxer->OpenChannel(channel)) {
+        delete VNSIDemuxer;
+        VNSIDemuxer = nullptr;
+        return false;
+      }
     }
 
+    if (VNSIZapper)
+      VNSIDemuxer->StartZapTimer(VNSIZapper, start, warm);
+
     return true;
   }
   catch (std::exception e)
@@ -963,7 +1129,11 @@ PVR_ERROR GetRecordingEdl(const PVR_RECORDING& recinfo, PVR_EDL_ENTRY edl[], int
 
 PVR_ERROR GetStreamReadChunkSize(int* chunksize)
 {
-  *chunksize = g_iChunkSize;
+  // an open recording knows what suits the link
+  if (VNSIRecording)
+    *chunksize = VNSIRecording->GetChunkStats().chunkSize;
+  else
+    *chunksize = g_iChunkSize;
   return PVR_ERROR_NO_ERROR;
 }
 
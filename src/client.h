@@ -32,6 +32,14 @@
 #define DEFAULT_TIMEOUT       3
 #define DEFAULT_AUTOGROUPS    false
 #define DEFAULT_CHUNKSIZE     65536
+#define DEFAULT_PREFETCH      false
+#define DEFAULT_PREFETCH_PKTS 1000
+#define DEFAULT_PREFETCH_KB   16384
+#define DEFAULT_STANDBY       0
+#define DEFAULT_LIVEBUFFER    false
+#define DEFAULT_LIVEBUFFER_MB 64
+#define DEFAULT_LIVEBUFFER_DISK_MB 1024
+#define DEFAULT_RECCACHE_MB   32
 
 extern bool         m_bCreated;
 extern std::string  g_szHostname;         ///< hostname or ip-address of the server
@@ -41,6 +49,16 @@ extern int          g_iPriority;          ///< The Priority this client have in
 extern bool         g_bCharsetConv;       ///< Convert VDR's incoming strings to UTF8 character set
 extern int          g_iTimeshift;
 extern std::string  g_szIconPath;         ///< path to channel icons
+extern int          g_iChunkSize;         ///< Initial size of recording blocks requested from the server
+extern bool         g_bPrefetch;          ///< Receive live streams on a background thread
+extern int          g_iPrefetchPackets;   ///< Max. packets queued by the live stream receiver
+extern int          g_iPrefetchKBytes;    ///< Max. KiB queued by the live stream receiver
+extern int          g_iStandbySessions;   ///< Connected sessions kept ready for channel switches
+extern bool         g_bLiveBuffer;        ///< Keep recent live TV packets in memory for local seeks
+extern int          g_iLiveBufferMB;      ///< Memory limit of the live buffer in MiB
+extern std::string  g_szLiveBufferDir;    ///< Directory for a file backed live buffer, memory if empty
+extern int          g_iLiveBufferDiskMB;  ///< Size of the live buffer file in MiB
+extern int          g_iRecCacheMB;        ///< Memory for recently read recording blocks in MiB, 0 disables
 
 extern ADDON::CHelper_libXBMC_addon *XBMC;
 extern CHelper_libKODI_guilib *GUI;
@@ -0,0 +1,182 @@
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include "demuxstats.h"
+#include "client.h"
+
+using namespace ADDON;
+
+cDemuxStats::cDemuxStats()
+{
+  Reset();
+}
+
+void cDemuxStats::Reset()
+{
+  memset(&m_stats, 0, sizeof(m_stats));
+  memset(m_state, 0, sizeof(m_state));
+  m_lastArrival = 0;
+  m_periodStart = NowUs();
+  m_refOffset = kNoReference;
+  m_driftValid = false;
+}
+
+int64_t cDemuxStats::NowUs()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t cDemuxStats::WallUs()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int cDemuxStats::Bucket(uint64_t value)
+{
+  int bucket = 0;
+  while (value > 0 && bucket < kBuckets - 1)
+  {
+    value >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+void cDemuxStats::SetReference(time_t refTime, int64_t refDTS)
+{
+  // a single value, the demux thread never sees half of an update
+  m_refOffset = refTime > 0 ? (int64_t)refTime * 1000000 - refDTS : kNoReference;
+}
+
+bool cDemuxStats::Packet(int stream, uint32_t pid, size_t bytes, int64_t dts, size_t queued)
+{
+  int64_t now = NowUs();
+
+  m_stats.packets++;
+
+  if (m_lastArrival)
+    m_stats.interArrivalMs[Bucket((now - m_lastArrival) / 1000)]++;
+  m_lastArrival = now;
+  m_stats.queueDepth[Bucket(queued)]++;
+
+  if (stream >= 0 && stream < kMaxStreams)
+  {
+    if (stream >= m_stats.streamCount)
+      m_stats.streamCount = stream + 1;
+
+    SStream &info = m_stats.streams[stream];
+    SStreamState &state = m_state[stream];
+    if (info.pid != pid)
+    {
+      memset(&info, 0, sizeof(info));
+      memset(&state, 0, sizeof(state));
+      info.pid = pid;
+    }
+    info.packets++;
+    state.bytes += bytes;
+
+    // dts is in microseconds, so is the transit time
+    if (dts >= 0)
+    {
+      int64_t transit = now - dts;
+      if (state.valid)
+      {
+        int64_t d = llabs(transit - state.lastTransit);
+        info.jitterMs += (d / 1000.0 - info.jitterMs) / 16;
+      }
+      state.lastTransit = transit;
+      state.valid = true;
+
+      // sample the drift now and then, it only moves slowly
+      int64_t refOffset = (m_stats.packets & 63) == 0 ? (int64_t)m_refOffset : kNoReference;
+      if (refOffset != kNoReference)
+      {
+        int64_t drift = (WallUs() - (refOffset + dts)) / 1000;
+        m_stats.driftMs = drift;
+        if (!m_driftValid || drift < m_stats.minDriftMs)
+          m_stats.minDriftMs = drift;
+        if (!m_driftValid || drift > m_stats.maxDriftMs)
+          m_stats.maxDriftMs = drift;
+        m_driftValid = true;
+      }
+    }
+  }
+
+  if (now - m_periodStart < (int64_t)kPeriod * 1000000)
+    return false;
+
+  int64_t period = now - m_periodStart;
+  for (int i = 0; i < m_stats.streamCount; i++)
+  {
+    m_stats.streams[i].kbits = (uint32_t)(m_state[i].bytes * 8 * 1000 / period);
+    m_state[i].bytes = 0;
+  }
+  m_periodStart = now;
+  return true;
+}
+
+void cDemuxStats::Discarded()
+{
+  m_stats.discarded++;
+}
+
+void cDemuxStats::Log()
+{
+  const SStats &stats = m_stats;
+
+  // the upper bound of the bucket holding the median and the 99th percentile
+  uint64_t total = 0;
+  for (int i = 0; i < kBuckets; i++)
+    total += stats.interArrivalMs[i];
+  int p50 = 0, p99 = 0;
+  uint64_t sum = 0;
+  for (int i = 0; i < kBuckets; i++)
+  {
+    sum += stats.interArrivalMs[i];
+    if (sum * 2 < total)
+      p50 = i + 1;
+    if (sum * 100 < total * 99)
+      p99 = i + 1;
+  }
+
+  int maxDepth = 0;
+  for (int i = 0; i < kBuckets; i++)
+    if (stats.queueDepth[i])
+      maxDepth = i;
+
+  XBMC->Log(LOG_DEBUG, "%s - %llu packets, %llu discarded, inter-arrival p50 < %d ms, p99 < %d ms, queue depth < %d, drift %lld ms (%lld..%lld)",
+            __FUNCTION__, (unsigned long long)stats.packets, (unsigned long long)stats.discarded,
+            1 << p50, 1 << p99, 1 << maxDepth,
+            (long long)stats.driftMs, (long long)stats.minDriftMs, (long long)stats.maxDriftMs);
+
+  for (int i = 0; i < stats.streamCount; i++)
+  {
+    if (!stats.streams[i].packets)
+      continue;
+    XBMC->Log(LOG_DEBUG, "%s - pid %u: %u kbit/s, jitter %.1f ms", __FUNCTION__,
+              stats.streams[i].pid, stats.streams[i].kbits, stats.streams[i].jitterMs);
+  }
+}
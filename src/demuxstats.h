@@ -0,0 +1,106 @@
+#pragma once
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <atomic>
+
+/*!
+ * Latency and jitter figures of a live stream, cheap enough to be always on:
+ * fixed size histograms, no allocation per packet.
+ *
+ * Arrival is the moment the packet reaches the demuxer, i.e. after the
+ * background receiver queue if that is enabled.
+ *
+ * Everything but SetReference() is called on the demux thread only, so the
+ * figures need no lock. The reference comes from the status connection.
+ */
+class cDemuxStats
+{
+public:
+
+  static const int kBuckets = 16;     ///< bucket i counts values below 2^i
+  static const int kMaxStreams = 16;
+  static const int kPeriod = 10;      ///< seconds between figures updates
+
+  struct SStream
+  {
+    uint32_t pid;
+    uint64_t packets;
+    uint32_t kbits;                   ///< bitrate over the last period
+    double   jitterMs;                ///< RFC 3550 style inter-arrival jitter
+  };
+
+  struct SStats
+  {
+    uint64_t packets;
+    uint64_t discarded;               ///< mux packets of an old serial, after seeks
+    uint32_t interArrivalMs[kBuckets];
+    uint32_t queueDepth[kBuckets];
+    int64_t  driftMs;                 ///< arrival vs. reference time of the dts
+    int64_t  minDriftMs;
+    int64_t  maxDriftMs;
+    int      streamCount;
+    SStream  streams[kMaxStreams];
+  };
+
+  cDemuxStats();
+
+  void Reset();
+
+  /*!
+   * Account a mux packet, dts in microseconds. stream is the index in the
+   * demuxer's stream table. Returns true once per period, time to log.
+   */
+  bool Packet(int stream, uint32_t pid, size_t bytes, int64_t dts, size_t queued);
+  void Discarded();
+
+  /*!
+   * Reference to convert dts to wall clock time, see VNSI_STREAM_TIMES
+   */
+  void SetReference(time_t refTime, int64_t refDTS);
+
+  void Log();
+
+private:
+
+  struct SStreamState
+  {
+    uint64_t bytes;
+    int64_t  lastTransit;
+    bool     valid;
+  };
+
+  static int Bucket(uint64_t value);
+  static int64_t NowUs();
+  static int64_t WallUs();
+
+  static const int64_t kNoReference = INT64_MIN;
+
+  SStats m_stats;
+  SStreamState m_state[kMaxStreams];
+  int64_t m_lastArrival;
+  int64_t m_periodStart;
+  std::atomic<int64_t> m_refOffset;   ///< wall clock minus dts, kNoReference if unknown
+  bool m_driftValid;
+};
@@ -0,0 +1,434 @@
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "livebuffer.h"
+#include "client.h"
+
+#ifndef TARGET_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+using namespace ADDON;
+using namespace P8PLATFORM;
+
+cLiveBuffer::cLiveBuffer()
+  : m_hasVideo(false)
+  , m_ring(nullptr)
+  , m_capacity(0)
+  , m_fd(-1)
+  , m_tail(0)
+  , m_head(0)
+  , m_cursor(0)
+  , m_played(0)
+  , m_replaying(false)
+  , m_newest(0)
+  , m_indexed(false)
+  , m_hits(0)
+  , m_misses(0)
+{
+}
+
+cLiveBuffer::~cLiveBuffer()
+{
+  Release();
+}
+
+void cLiveBuffer::Release()
+{
+#ifndef TARGET_WINDOWS
+  if (m_fd >= 0)
+  {
+    munmap(m_ring, m_capacity);
+    close(m_fd);
+    m_fd = -1;
+  }
+  else
+#endif
+    free(m_ring);
+
+  m_ring = nullptr;
+  m_capacity = 0;
+  m_path.clear();
+}
+
+void cLiveBuffer::SetStorage(size_t bytes, const std::string &directory)
+{
+  CLockObject lock(m_mutex);
+
+  // records are 8 byte aligned, so is the end of the ring
+  bytes &= ~(size_t)7;
+
+  std::string path;
+  if (bytes > 0 && !directory.empty())
+  {
+    path = directory;
+    if (path[path.size() - 1] != '/' && path[path.size() - 1] != '\\')
+      path += '/';
+    path += "vnsi-livebuffer.bin";
+  }
+
+  // keep the ring, and what is in it, if nothing changed
+  if (bytes == m_capacity && path == m_path)
+    return;
+
+  Release();
+  Clear();
+  if (bytes < RecordSize(0) * 2)
+    return;
+
+#ifndef TARGET_WINDOWS
+  if (!path.empty())
+  {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    off_t size = fd >= 0 ? lseek(fd, 0, SEEK_END) : -1;
+    if (fd >= 0 && (size == (off_t)bytes || ftruncate(fd, bytes) == 0))
+    {
+      void *ring = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (ring != MAP_FAILED)
+      {
+        m_ring = (uint8_t*)ring;
+        m_capacity = bytes;
+        m_path = path;
+        m_fd = fd;
+        return;
+      }
+    }
+    XBMC->Log(LOG_ERROR, "%s - can't map '%s' (%s), buffering in memory", __FUNCTION__, path.c_str(), strerror(errno));
+    if (fd >= 0)
+      close(fd);
+  }
+#endif
+
+  m_ring = (uint8_t*)malloc(bytes);
+  if (m_ring)
+    m_capacity = bytes;
+  else
+    XBMC->Log(LOG_ERROR, "%s - can't allocate %d MiB, live buffer disabled", __FUNCTION__, (int)(bytes >> 20));
+}
+
+void cLiveBuffer::Clear()
+{
+  CLockObject lock(m_mutex);
+  // offsets keep growing, packets queued before are recognised as old
+  m_tail = m_cursor = m_played = m_head;
+  m_replaying = false;
+  m_newest = 0;
+  m_keyFrames.clear();
+  m_indexed = false;
+}
+
+void cLiveBuffer::Reset()
+{
+  CLockObject lock(m_mutex);
+  Clear();
+  m_streams.clear();
+  m_hasVideo = false;
+}
+
+void cLiveBuffer::AddStream(uint32_t pid, const char *codec)
+{
+  eCodec type = CODEC_OTHER;
+  if (!strcmp(codec, "MPEG2VIDEO"))
+    type = CODEC_MPEG2;
+  else if (!strcmp(codec, "H264"))
+    type = CODEC_H264;
+  else if (!strcmp(codec, "HEVC"))
+    type = CODEC_HEVC;
+  else if (!strcmp(codec, "MPEG2AUDIO") || !strcmp(codec, "AC3") || !strcmp(codec, "EAC3") ||
+           !strcmp(codec, "AAC") || !strcmp(codec, "AAC_LATM") || !strcmp(codec, "DTS"))
+    type = CODEC_AUDIO;
+
+  CLockObject lock(m_mutex);
+  m_streams[pid] = type;
+  if (type == CODEC_MPEG2 || type == CODEC_H264 || type == CODEC_HEVC)
+    m_hasVideo = true;
+}
+
+cLiveBuffer::SRecord* cLiveBuffer::RecordAt(uint64_t offset)
+{
+  return (SRecord*)(m_ring + offset % m_capacity);
+}
+
+uint64_t cLiveBuffer::NextRecord(uint64_t offset)
+{
+  SRecord *rec = RecordAt(offset);
+  if (rec->size == kWrap)
+    return offset - offset % m_capacity + m_capacity;
+  return offset + RecordSize(rec->size);
+}
+
+uint64_t cLiveBuffer::NextKeyFrame(uint64_t offset)
+{
+  for (; offset < m_head; offset = NextRecord(offset))
+  {
+    SRecord *rec = RecordAt(offset);
+    if (rec->size != kWrap && rec->key)
+      break;
+  }
+  return offset < m_head ? offset : m_head;
+}
+
+void cLiveBuffer::Evict(uint64_t end)
+{
+  while (m_tail < m_head && end - m_tail > m_capacity)
+    m_tail = NextRecord(m_tail);
+
+  if (m_tail >= m_head)
+    m_tail = m_head;
+
+  while (!m_keyFrames.empty() && m_keyFrames.front().offset < m_tail)
+    m_keyFrames.pop_front();
+
+  // replay fell out of the window, continue at a picture that decodes on
+  // its own rather than in the middle of a group of pictures
+  if (m_replaying && m_cursor < m_tail)
+    m_cursor = NextKeyFrame(m_tail);
+}
+
+void cLiveBuffer::Add(const DemuxPacket *pkt, uint64_t *offset)
+{
+  if (offset)
+    *offset = kNoRecord;
+
+  CLockObject lock(m_mutex);
+  if (!m_capacity || pkt->iSize <= 0)
+    return;
+
+  auto it = m_streams.find(pkt->iStreamId);
+  if (it == m_streams.end())
+    return;
+
+  size_t total = RecordSize(pkt->iSize);
+  if (total > m_capacity / 2)
+    return;
+
+  // records never straddle the end of the ring, mark the rest unused
+  uint64_t pos = m_head;
+  size_t room = m_capacity - pos % m_capacity;
+  if (room < total)
+  {
+    Evict(pos + room);
+    if (room >= sizeof(uint32_t))
+      RecordAt(pos)->size = kWrap;
+    pos += room;
+    m_head = pos;
+  }
+  Evict(pos + total);
+
+  SRecord *rec = RecordAt(pos);
+  rec->size = pkt->iSize;
+  rec->streamId = pkt->iStreamId;
+  rec->pts = pkt->pts;
+  rec->dts = pkt->dts >= 0 ? pkt->dts : pkt->pts;
+  rec->duration = pkt->duration;
+  memcpy(rec + 1, pkt->pData, pkt->iSize);
+
+  // replay starts at pictures that decode on their own, or at any audio
+  // frame on radio channels
+  if (rec->dts < 0)
+    rec->key = 0;
+  else if (m_hasVideo)
+    rec->key = IsKeyFrame(it->second, pkt->pData, pkt->iSize);
+  else
+    rec->key = it->second == CODEC_AUDIO;
+
+  if (rec->dts >= 0)
+    m_newest = rec->dts;
+  if (m_indexed && rec->key)
+    m_keyFrames.push_back({pos, rec->dts});
+
+  m_head = pos + total;
+  if (offset)
+    *offset = pos;
+}
+
+bool cLiveBuffer::Played(uint64_t offset)
+{
+  CLockObject lock(m_mutex);
+  if (offset == kNoRecord || m_replaying)
+    return true;
+  if (offset < m_played)
+    return false;
+
+  // an evicted record can't be looked at anymore, Resume() starts at the
+  // tail then
+  m_played = offset < m_tail ? offset : NextRecord(offset);
+  return true;
+}
+
+bool cLiveBuffer::Resume()
+{
+  CLockObject lock(m_mutex);
+  if (!m_capacity || m_replaying)
+    return m_replaying;
+
+  m_cursor = m_played < m_tail ? NextKeyFrame(m_tail) : m_played;
+  m_replaying = m_cursor < m_head;
+  return m_replaying;
+}
+
+void cLiveBuffer::BuildIndex()
+{
+  m_keyFrames.clear();
+  for (uint64_t offset = m_tail; offset < m_head; offset = NextRecord(offset))
+  {
+    SRecord *rec = RecordAt(offset);
+    if (rec->size != kWrap && rec->key)
+      m_keyFrames.push_back({offset, rec->dts});
+  }
+  m_indexed = true;
+}
+
+bool cLiveBuffer::Seek(double dts, bool backwards, double *startpts)
+{
+  CLockObject lock(m_mutex);
+  if (!m_capacity)
+    return false;
+
+  if (!m_indexed)
+    BuildIndex();
+
+  if (m_keyFrames.empty() || dts < m_keyFrames.front().dts)
+  {
+    m_misses++;
+    return false;
+  }
+
+  if (dts >= m_newest)
+  {
+    // nothing newer than live, only useful when replaying
+    if (!m_replaying)
+    {
+      m_misses++;
+      return false;
+    }
+
+    m_replaying = false;
+    m_cursor = m_played = m_head;
+    if (startpts)
+      *startpts = m_newest;
+    m_hits++;
+    return true;
+  }
+
+  // key frames in ascending order of dts, find the last one not after dts
+  auto it = std::upper_bound(m_keyFrames.begin(), m_keyFrames.end(), dts,
+    [](double value, const SKeyFrame &key) { return value < key.dts; });
+  if (it != m_keyFrames.begin())
+    --it;
+
+  // moving forwards prefers the next key frame, if there is one
+  if (!backwards && it->dts < dts && (it + 1) != m_keyFrames.end())
+    ++it;
+
+  m_cursor = it->offset;
+  m_replaying = true;
+  if (startpts)
+    *startpts = it->dts;
+  m_hits++;
+  return true;
+}
+
+DemuxPacket* cLiveBuffer::Next()
+{
+  CLockObject lock(m_mutex);
+  if (!m_replaying)
+    return nullptr;
+
+  while (m_cursor < m_head && RecordAt(m_cursor)->size == kWrap)
+    m_cursor = NextRecord(m_cursor);
+
+  if (m_cursor >= m_head)
+  {
+    m_replaying = false;
+    return nullptr;
+  }
+
+  SRecord *rec = RecordAt(m_cursor);
+  DemuxPacket *pkt = PVR->AllocateDemuxPacket(rec->size);
+  if (!pkt)
+    return nullptr;
+
+  memcpy(pkt->pData, rec + 1, rec->size);
+  pkt->iSize = rec->size;
+  pkt->iStreamId = rec->streamId;
+  pkt->pts = rec->pts;
+  pkt->dts = rec->dts;
+  pkt->duration = rec->duration;
+  m_cursor = m_played = NextRecord(m_cursor);
+  return pkt;
+}
+
+cLiveBuffer::SStats cLiveBuffer::GetStats()
+{
+  CLockObject lock(m_mutex);
+  SStats stats;
+  stats.hits = m_hits;
+  stats.misses = m_misses;
+  stats.bytes = (size_t)(m_head - m_tail);
+  stats.capacity = m_capacity;
+  stats.file = m_fd >= 0;
+  return stats;
+}
+
+bool cLiveBuffer::IsKeyFrame(eCodec codec, const uint8_t *data, int size)
+{
+  // parameter sets lead the access unit, no need to scan whole pictures
+  const int limit = std::min(size, 1024) - 4;
+
+  for (int i = 0; i < limit; i++)
+  {
+    if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1)
+      continue;
+
+    uint8_t code = data[i + 3];
+    switch (codec)
+    {
+    case CODEC_MPEG2:
+      // sequence header or group of pictures
+      if (code == 0xB3 || code == 0xB8)
+        return true;
+      break;
+    case CODEC_H264:
+      // IDR slice or sequence parameter set
+      if ((code & 0x1F) == 5 || (code & 0x1F) == 7)
+        return true;
+      break;
+    case CODEC_HEVC:
+      // IRAP pictures and parameter sets
+      if (((code >> 1) & 0x3F) >= 16 && ((code >> 1) & 0x3F) <= 23)
+        return true;
+      if (((code >> 1) & 0x3F) >= 32 && ((code >> 1) & 0x3F) <= 34)
+        return true;
+      break;
+    default:
+      return false;
+    }
+    i += 2;
+  }
+  return false;
+}
@@ -0,0 +1,182 @@
+#pragma once
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <map>
+#include <string>
+#include "p8-platform/threads/mutex.h"
+
+struct DemuxPacket;
+
+/*!
+ * Bounded copy of the most recent live TV packets, kept in memory or in a
+ * memory mapped file.
+ *
+ * Packets are appended as records to a byte ring, the oldest records are
+ * overwritten once it is full. Seeks that land inside the ring start
+ * replaying from the nearest key frame without asking the server. The live
+ * stream keeps being appended while replaying, so playback simply stays
+ * behind by the seek distance.
+ *
+ * The key frame index is only built when the first seek needs it, until
+ * then appending is a plain copy.
+ *
+ * Packets may be appended before the player asks for them, e.g. by a
+ * receiver thread while playback is paused. Played() and Resume() keep
+ * track of what the player got already.
+ */
+class cLiveBuffer
+{
+public:
+
+  static const uint64_t kNoRecord = ~(uint64_t)0;
+
+  struct SStats
+  {
+    uint64_t hits;        ///< seeks served from the buffer
+    uint64_t misses;      ///< seeks passed on to the server
+    size_t   bytes;       ///< bytes in use
+    size_t   capacity;
+    bool     file;        ///< backed by a file
+  };
+
+  cLiveBuffer();
+  ~cLiveBuffer();
+
+  /*!
+   * Size the ring, 0 disables the buffer. With a directory the ring lives
+   * in a file there, an existing file of the same size is reused as is.
+   */
+  void SetStorage(size_t bytes, const std::string &directory = "");
+  bool IsEnabled() const { return m_capacity > 0; }
+
+  /*!
+   * Drop all packets, stream setup is kept
+   */
+  void Clear();
+
+  /*!
+   * Drop packets and stream setup, streams are announced again with
+   * AddStream() after a stream change
+   */
+  void Reset();
+  void AddStream(uint32_t pid, const char *codec);
+
+  /*!
+   * Append a copy of pkt, offset tells where it was stored or is kNoRecord
+   * if the packet is not buffered
+   */
+  void Add(const DemuxPacket *pkt, uint64_t *offset = nullptr);
+
+  /*!
+   * The packet stored at offset goes to the player from the live stream.
+   * Returns false if replay handed it out already, the caller drops it then.
+   */
+  bool Played(uint64_t offset);
+
+  /*!
+   * Replay whatever was appended after the last packet the player got,
+   * starting at the next key frame if that fell out of the buffer
+   */
+  bool Resume();
+
+  /*!
+   * Position replay at the key frame nearest to dts. Returns false if dts
+   * is not covered by the buffer, the caller has to ask the server then.
+   */
+  bool Seek(double dts, bool backwards, double *startpts);
+
+  bool IsReplaying() const { return m_replaying; }
+
+  /*!
+   * Copy of the next buffered packet, nullptr once replay caught up with
+   * the live stream.
+   */
+  DemuxPacket* Next();
+
+  SStats GetStats();
+
+private:
+
+  enum eCodec
+  {
+    CODEC_OTHER,
+    CODEC_MPEG2,
+    CODEC_H264,
+    CODEC_HEVC,
+    CODEC_AUDIO
+  };
+
+  struct SRecord
+  {
+    uint32_t size;        ///< payload size, kWrap marks the end of the ring
+    int32_t  streamId;
+    double   pts;
+    double   dts;
+    double   duration;
+    uint32_t key;
+    uint32_t reserved;
+  };
+
+  struct SKeyFrame
+  {
+    uint64_t offset;
+    double   dts;
+  };
+
+  static const uint32_t kWrap = 0xFFFFFFFF;
+
+  static bool IsKeyFrame(eCodec codec, const uint8_t *data, int size);
+  static size_t RecordSize(uint32_t size) { return (sizeof(SRecord) + size + 7) & ~(size_t)7; }
+
+  void Release();
+  SRecord* RecordAt(uint64_t offset);
+  uint64_t NextRecord(uint64_t offset);
+  uint64_t NextKeyFrame(uint64_t offset);
+  void Evict(uint64_t end);
+  void BuildIndex();
+
+  P8PLATFORM::CMutex m_mutex;
+  std::map<uint32_t, eCodec> m_streams;
+  bool m_hasVideo;
+
+  uint8_t *m_ring;
+  size_t m_capacity;
+  std::string m_path;
+  int m_fd;
+
+  // logical byte offsets, the position in the ring is offset % m_capacity
+  uint64_t m_tail;
+  uint64_t m_head;
+  uint64_t m_cursor;
+  uint64_t m_played;    ///< end of the last record the player got
+  bool m_replaying;
+  double m_newest;
+
+  std::deque<SKeyFrame> m_keyFrames;
+  bool m_indexed;
+
+  uint64_t m_hits;
+  uint64_t m_misses;
+};
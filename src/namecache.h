@@ -0,0 +1,63 @@
+#pragma once
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <map>
+#include <string>
+#include "p8-platform/threads/mutex.h"
+
+/*!
+ * Thread safe cache for values looked up by name, where the lookup costs
+ * much more than a map search and the same few names keep coming back.
+ */
+template<typename V>
+class cNameCache
+{
+public:
+
+  /*!
+   * Value for name, lookup(name) only runs the first time a name is asked
+   * for
+   */
+  template<typename F>
+  V Get(const char *name, F lookup)
+  {
+    P8PLATFORM::CLockObject lock(m_mutex);
+    auto it = m_values.find(name);
+    if (it != m_values.end())
+      return it->second;
+
+    V value = lookup(name);
+    m_values.insert(std::make_pair(std::string(name), value));
+    return value;
+  }
+
+  size_t Size()
+  {
+    P8PLATFORM::CLockObject lock(m_mutex);
+    return m_values.size();
+  }
+
+private:
+
+  P8PLATFORM::CMutex m_mutex;
+  std::map<std::string, V> m_values;
+};
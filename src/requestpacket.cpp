@@ -25,15 +25,16 @@
 #include "p8-platform/sockets/tcp.h"
 
 #include <assert.h>
+#include <new>
 #include <stdlib.h>
 #include <string.h>
 
-uint32_t cRequestPacket::serialNumberCounter = 1;
+std::atomic<uint32_t> cRequestPacket::serialNumberCounter(1);
 
 cRequestPacket::cRequestPacket()
 {
-  buffer        = NULL;
-  bufSize       = 0;
+  buffer        = inlineBuffer;
+  bufSize       = inlineLength;
   bufUsed       = 0;
   lengthSet     = false;
   serialNumber  = 0;
@@ -42,32 +43,29 @@ cRequestPacket::cRequestPacket()
 
 cRequestPacket::~cRequestPacket()
 {
-  free(buffer);
+  if (buffer != inlineBuffer)
+    free(buffer);
 }
 
 void cRequestPacket::init(uint32_t topcode, bool stream, bool setUserDataLength, size_t userDataLength)
 {
-  assert(buffer == NULL);
+  assert(bufUsed == 0);
 
   if (setUserDataLength)
   {
-    bufSize = headerLength + userDataLength;
+    resize(headerLength + userDataLength);
     lengthSet = true;
   }
   else
   {
-    bufSize = 512;
     userDataLength = 0; // so the below will write a zero
   }
 
-  buffer = (uint8_t*)malloc(bufSize);
-  if (!buffer) throw std::bad_alloc();
-
   if (!stream)
     channel     = VNSI_CHANNEL_REQUEST_RESPONSE;
   else
     channel     = VNSI_CHANNEL_STREAM;
-  serialNumber  = serialNumberCounter++;
+  serialNumber  = serialNumberCounter.fetch_add(1);
   opcode        = topcode;
 
   uint32_t ul;
@@ -163,17 +161,26 @@ void cRequestPacket::checkExtend(size_t by)
 {
   if (lengthSet) return;
   if ((bufUsed + by) <= bufSize) return;
-  uint8_t* newBuf = (uint8_t*)realloc(buffer, bufUsed + by);
+
+  // grow geometrically, appending many strings stays linear
+  size_t newSize = bufSize * 2;
+  if (newSize < bufUsed + by)
+    newSize = bufUsed + by;
+  resize(newSize);
+}
+
+void cRequestPacket::resize(size_t size)
+{
+  if (size <= bufSize) return;
+
+  uint8_t* newBuf = (uint8_t*)malloc(size);
   if (!newBuf)
-  {
-    newBuf = (uint8_t*)malloc(bufUsed + by);
-    if (!newBuf) {
-      throw std::bad_alloc();
-    }
-    memcpy(newBuf, buffer, bufUsed);
+    throw std::bad_alloc();
+
+  memcpy(newBuf, buffer, bufUsed);
+  if (buffer != inlineBuffer)
     free(buffer);
-  }
+
   buffer = newBuf;
-  bufSize = bufUsed + by;
+  bufSize = size;
 }
-
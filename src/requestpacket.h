@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <atomic>
 
 class cRequestPacket
 {
@@ -29,6 +30,9 @@ class cRequestPacket
     cRequestPacket();
     ~cRequestPacket();
 
+    cRequestPacket(const cRequestPacket&) = delete;
+    cRequestPacket& operator=(const cRequestPacket&) = delete;
+
     void init(uint32_t opcode, bool stream = false, bool setUserDataLength = false, size_t userDataLength = 0);
     void add_String(const char* string);
     void add_U8(uint8_t c);
@@ -45,7 +49,7 @@ class cRequestPacket
     uint32_t getOpcode() const { return opcode; }
 
   private:
-    static uint32_t serialNumberCounter;
+    static std::atomic<uint32_t> serialNumberCounter;
 
     uint8_t* buffer;
     size_t bufSize;
@@ -58,7 +62,12 @@ class cRequestPacket
     uint32_t opcode;
 
     void checkExtend(size_t by);
+    void resize(size_t size);
 
     const static size_t headerLength = 16;
     const static size_t userDataLenPos = 12;
+
+    // most requests fit here and need no heap buffer at all
+    const static size_t inlineLength = 128;
+    uint8_t inlineBuffer[inlineLength];
 };
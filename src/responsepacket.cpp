@@ -20,6 +20,7 @@
  */
 
 #include "responsepacket.h"
+#include "responsepool.h"
 #include "vnsicommand.h"
 #include "tools.h"
 #include "p8-platform/sockets/tcp.h"
@@ -36,6 +37,7 @@ cResponsePacket::cResponsePacket()
   channelID       = 0;
   requestID       = 0;
   streamID        = 0;
+  opcodeID        = 0;
 }
 
 cResponsePacket::~cResponsePacket()
@@ -45,10 +47,30 @@ cResponsePacket::~cResponsePacket()
     if (channelID == VNSI_CHANNEL_STREAM && opcodeID == VNSI_STREAM_MUXPKT)
       PVR->FreeDemuxPacket((DemuxPacket*)userData); 
     else
-      free(userData);
+      cResponsePool::Free(userData);
   }
 }
 
+void* cResponsePacket::operator new(size_t size)
+{
+  return cResponsePool::AllocateUnpooled(size);
+}
+
+void* cResponsePacket::operator new(size_t size, cResponsePool& pool)
+{
+  return pool.Allocate(size);
+}
+
+void cResponsePacket::operator delete(void* ptr)
+{
+  cResponsePool::Free(ptr);
+}
+
+void cResponsePacket::operator delete(void* ptr, cResponsePool&)
+{
+  cResponsePool::Free(ptr);
+}
+
 void cResponsePacket::getOSDData(uint32_t &wnd, uint32_t &color, uint32_t &x0, uint32_t &y0, uint32_t &x1, uint32_t &y1)
 {
   wnd = osdWnd;
@@ -144,6 +166,8 @@ void cResponsePacket::extractOSDHeader()
   osdX1    = extract_S32();
   osdY1    = extract_S32();
   userDataLength = extract_U32();
+
+  userData = NULL;
 }
 
 char* cResponsePacket::extract_String()
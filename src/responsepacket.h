@@ -24,12 +24,20 @@
 #include <stdint.h>
 #include <stddef.h>
 
+class cResponsePool;
+
 class cResponsePacket
 {
   public:
     cResponsePacket();
     ~cResponsePacket();
 
+    // packets and their non-demux payloads live in a cResponsePool
+    static void* operator new(size_t size);
+    static void* operator new(size_t size, cResponsePool& pool);
+    static void operator delete(void* ptr);
+    static void operator delete(void* ptr, cResponsePool& pool);
+
     void setResponse(uint8_t* packet, size_t packetLength);
     void setStatus(uint8_t* packet, size_t packetLength);
     void setStream(uint8_t* packet, size_t packetLength);
@@ -66,7 +74,8 @@ class cResponsePacket
     int64_t   extract_S64();
     double    extract_Double();
 
-    // If you call this, the memory becomes yours. Free with free()
+    // If you call this, the memory becomes yours. Free with
+    // PVR->FreeDemuxPacket() for mux packets, cResponsePool::Free() otherwise
     uint8_t* stealUserData();
 
     uint8_t* getUserData();
@@ -0,0 +1,140 @@
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "responsepool.h"
+
+#include <stdlib.h>
+#include <new>
+
+using namespace P8PLATFORM;
+
+const size_t cResponsePool::kSizes[cResponsePool::kClasses] =
+{
+  128, 512, 2048, 8192, 32768, 131072
+};
+
+cResponsePool::cResponsePool()
+{
+  m_stats.hits = 0;
+  m_stats.misses = 0;
+  m_stats.oversized = 0;
+
+  for (size_t i = 0; i < kClasses; i++)
+    m_free[i].reserve(kMaxFree);
+}
+
+cResponsePool::~cResponsePool()
+{
+  for (size_t i = 0; i < kClasses; i++)
+  {
+    for (auto block : m_free[i])
+      free(block);
+  }
+}
+
+void* cResponsePool::Init(void* block, std::shared_ptr<cResponsePool> pool, size_t sizeClass)
+{
+  SHeader* header = new (block) SHeader;
+  header->pool = std::move(pool);
+  header->sizeClass = sizeClass;
+  return (uint8_t*)block + kHeaderSize;
+}
+
+void* cResponsePool::Allocate(size_t size)
+{
+  size_t sizeClass = 0;
+  while (sizeClass < kClasses && kSizes[sizeClass] < size)
+    sizeClass++;
+
+  if (sizeClass == kClasses)
+  {
+    {
+      CLockObject lock(m_mutex);
+      m_stats.oversized++;
+    }
+    return AllocateUnpooled(size);
+  }
+
+  void* block = nullptr;
+  {
+    CLockObject lock(m_mutex);
+    if (!m_free[sizeClass].empty())
+    {
+      block = m_free[sizeClass].back();
+      m_free[sizeClass].pop_back();
+      m_stats.hits++;
+    }
+    else
+      m_stats.misses++;
+  }
+
+  if (!block)
+  {
+    block = malloc(kHeaderSize + kSizes[sizeClass]);
+    if (!block)
+      throw std::bad_alloc();
+  }
+
+  return Init(block, shared_from_this(), sizeClass);
+}
+
+void* cResponsePool::AllocateUnpooled(size_t size)
+{
+  void* block = malloc(kHeaderSize + size);
+  if (!block)
+    throw std::bad_alloc();
+
+  return Init(block, nullptr, kClasses);
+}
+
+void cResponsePool::Free(void* ptr)
+{
+  if (!ptr)
+    return;
+
+  void* block = (uint8_t*)ptr - kHeaderSize;
+  SHeader* header = (SHeader*)block;
+
+  // keep the pool alive until the block is back in its free list
+  std::shared_ptr<cResponsePool> pool = std::move(header->pool);
+  size_t sizeClass = header->sizeClass;
+  header->~SHeader();
+
+  if (pool && sizeClass < kClasses)
+    pool->Put(block, sizeClass);
+  else
+    free(block);
+}
+
+void cResponsePool::Put(void* block, size_t sizeClass)
+{
+  CLockObject lock(m_mutex);
+  if (m_free[sizeClass].size() < kMaxFree)
+    m_free[sizeClass].push_back(block);
+  else
+    free(block);
+}
+
+cResponsePool::SStats cResponsePool::GetStats()
+{
+  CLockObject lock(m_mutex);
+  return m_stats;
+}
@@ -0,0 +1,76 @@
+#pragma once
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <vector>
+#include "p8-platform/threads/mutex.h"
+
+/*!
+ * Size class pool for cResponsePacket objects and their payload buffers.
+ *
+ * Every block carries a small header with a reference to its pool, so it
+ * can be released with Free() from any thread, even after the owning
+ * session is gone. Requests above the largest class go to malloc.
+ */
+class cResponsePool : public std::enable_shared_from_this<cResponsePool>
+{
+public:
+
+  struct SStats
+  {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t oversized;
+  };
+
+  cResponsePool();
+  ~cResponsePool();
+
+  void* Allocate(size_t size);
+  static void* AllocateUnpooled(size_t size);
+  static void Free(void* ptr);
+
+  SStats GetStats();
+
+private:
+
+  static const size_t kClasses = 6;
+  static const size_t kMaxFree = 8;
+  static const size_t kSizes[kClasses];
+
+  struct SHeader
+  {
+    std::shared_ptr<cResponsePool> pool;
+    size_t sizeClass;
+  };
+
+  static const size_t kHeaderSize = (sizeof(SHeader) + 15) & ~(size_t)15;
+
+  static void* Init(void* block, std::shared_ptr<cResponsePool> pool, size_t sizeClass);
+  void Put(void* block, size_t sizeClass);
+
+  P8PLATFORM::CMutex m_mutex;
+  std::vector<void*> m_free[kClasses];
+  SStats m_stats;
+};
@@ -0,0 +1,170 @@
+#pragma once
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "p8-platform/threads/mutex.h"
+#include "p8-platform/util/timeutils.h"
+
+/*!
+ * Fixed table of response slots, open addressed by request serial.
+ * Slots and their events are reused, the receive thread only does
+ * atomic compare-and-swap to hand over a response.
+ */
+template<typename T>
+class cSlotTable
+{
+public:
+
+  static const size_t kSlots = 64;
+
+  struct SSlot
+  {
+    P8PLATFORM::CEvent event;
+    std::unique_ptr<T> value;
+
+    // serial in the upper, slot state in the lower 32 bit so that a
+    // response can never be matched against a recycled slot
+    std::atomic<uint64_t> tag{0};
+  };
+
+  /*!
+   * Claim a slot for serial. If all are in use wait up to timeout ms for
+   * one to be released, nullptr if none was.
+   */
+  SSlot *Enqueue(uint32_t serial, int timeout = 0);
+
+  /*!
+   * Release the slot, returns the value if it was set
+   */
+  std::unique_ptr<T> Dequeue(SSlot *slot);
+
+  /*!
+   * Hand value to the slot waiting for serial, false if there is none
+   */
+  bool Set(uint32_t serial, std::unique_ptr<T> &&value);
+
+private:
+
+  enum eSlotState : uint32_t
+  {
+    SLOT_FREE = 0,
+    SLOT_CLAIMED,
+    SLOT_WAITING,
+    SLOT_FILLING,
+    SLOT_DONE
+  };
+
+  static uint64_t Tag(uint32_t serial, eSlotState state) { return ((uint64_t)serial << 32) | state; }
+  static eSlotState State(uint64_t tag) { return (eSlotState)(tag & 0xffffffff); }
+
+  SSlot *Claim(uint32_t serial);
+
+  SSlot m_slots[kSlots];
+  P8PLATFORM::CEvent m_released;
+};
+
+template<typename T>
+typename cSlotTable<T>::SSlot *cSlotTable<T>::Claim(uint32_t serial)
+{
+  for (size_t i = 0; i < kSlots; i++)
+  {
+    SSlot &slot = m_slots[(serial + i) % kSlots];
+    uint64_t tag = slot.tag.load();
+    if (State(tag) != SLOT_FREE ||
+        !slot.tag.compare_exchange_strong(tag, Tag(serial, SLOT_CLAIMED)))
+      continue;
+
+    // drop a signal left over from a request that timed out
+    slot.event.Reset();
+    slot.value.reset();
+    slot.tag.store(Tag(serial, SLOT_WAITING));
+    return &slot;
+  }
+  return nullptr;
+}
+
+template<typename T>
+typename cSlotTable<T>::SSlot *cSlotTable<T>::Enqueue(uint32_t serial, int timeout)
+{
+  int64_t target = P8PLATFORM::GetTimeMs() + timeout;
+  for (;;)
+  {
+    SSlot *slot = Claim(serial);
+    if (slot)
+      return slot;
+
+    // a release wakes one waiter only, which may be beaten to the slot,
+    // so wait in short steps
+    int remaining = (int)(target - P8PLATFORM::GetTimeMs());
+    if (remaining <= 0)
+      return nullptr;
+    m_released.Wait(remaining < 10 ? remaining : 10);
+  }
+}
+
+template<typename T>
+std::unique_ptr<T> cSlotTable<T>::Dequeue(SSlot *slot)
+{
+  if (!slot)
+    return nullptr;
+
+  uint32_t serial = (uint32_t)(slot->tag.load() >> 32);
+
+  // no response yet, cancel so the receiver can't fill it anymore
+  uint64_t tag = Tag(serial, SLOT_WAITING);
+  if (slot->tag.compare_exchange_strong(tag, Tag(serial, SLOT_FREE)))
+  {
+    m_released.Signal();
+    return nullptr;
+  }
+
+  // the receiver is handing over the value right now
+  while (State(slot->tag.load()) == SLOT_FILLING)
+    std::this_thread::yield();
+
+  std::unique_ptr<T> value = std::move(slot->value);
+  slot->tag.store(Tag(serial, SLOT_FREE));
+  m_released.Signal();
+  return value;
+}
+
+template<typename T>
+bool cSlotTable<T>::Set(uint32_t serial, std::unique_ptr<T> &&value)
+{
+  for (size_t i = 0; i < kSlots; i++)
+  {
+    SSlot &slot = m_slots[(serial + i) % kSlots];
+    uint64_t tag = Tag(serial, SLOT_WAITING);
+    if (slot.tag.compare_exchange_strong(tag, Tag(serial, SLOT_FILLING)))
+    {
+      slot.value = std::move(value);
+      slot.tag.store(Tag(serial, SLOT_DONE));
+      slot.event.Broadcast();
+      return true;
+    }
+  }
+  return false;
+}
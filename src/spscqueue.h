@@ -0,0 +1,84 @@
+#pragma once
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+/*!
+ * Bounded lock-free queue for exactly one producer and one consumer thread.
+ */
+template<typename T>
+class cSPSCQueue
+{
+public:
+
+  explicit cSPSCQueue(size_t capacity = 0) { Resize(capacity); }
+
+  // only while neither side is running
+  void Resize(size_t capacity)
+  {
+    m_items.assign(capacity + 1, T());
+    m_head = 0;
+    m_tail = 0;
+  }
+
+  bool Push(const T& item)
+  {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t next = (tail + 1) % m_items.size();
+    if (next == m_head.load(std::memory_order_acquire))
+      return false;
+
+    m_items[tail] = item;
+    m_tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool Pop(T& item)
+  {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+      return false;
+
+    item = m_items[head];
+    m_head.store((head + 1) % m_items.size(), std::memory_order_release);
+    return true;
+  }
+
+  size_t Size() const
+  {
+    size_t head = m_head.load(std::memory_order_acquire);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    return (tail + m_items.size() - head) % m_items.size();
+  }
+
+  size_t Capacity() const { return m_items.size() - 1; }
+  bool Empty() const { return Size() == 0; }
+  bool Full() const { return Size() == Capacity(); }
+
+private:
+
+  std::vector<T> m_items;
+  std::atomic<size_t> m_head;
+  std::atomic<size_t> m_tail;
+};
@@ -0,0 +1,65 @@
+#pragma once
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*!
+ * Transport stream pid -> index in the demuxer's stream table. Pids are
+ * 13 bit, so a flat table answers every lookup with a single load.
+ */
+class cStreamIndex
+{
+public:
+
+  static const uint32_t kPids = 0x2000;
+  static const int kMaxIndex = 127;
+
+  cStreamIndex() { Clear(); }
+
+  void Clear() { memset(m_index, -1, sizeof(m_index)); }
+
+  /*!
+   * The first stream with a pid wins, pids outside the transport stream
+   * range and indexes above kMaxIndex are not kept
+   */
+  void Add(uint32_t pid, size_t index)
+  {
+    if (pid < kPids && m_index[pid] < 0 && index <= (size_t)kMaxIndex)
+      m_index[pid] = (int8_t)index;
+  }
+
+  /*!
+   * Index of the stream with pid, -1 if there is none
+   */
+  int Find(uint32_t pid) const { return pid < kPids ? m_index[pid] : -1; }
+
+  /*!
+   * False for pids the table can not hold, callers have to search them
+   */
+  static bool Covers(uint32_t pid) { return pid < kPids; }
+
+private:
+
+  int8_t m_index[kPids];
+};
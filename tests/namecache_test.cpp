@@ -0,0 +1,138 @@
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+/*
+ * cNameCache as used for the codec lookups in cVNSIDemux::StreamChange:
+ * concurrent callers get the right values and every name is looked up
+ * once. Then stream changes per second for a synthetic 20-stream mux,
+ * cached against an uncached stand-in for CodecDescriptor::GetCodecByName,
+ * which ends in a by-name search of FFmpeg's ~500 codecs inside Kodi.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "namecache.h"
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+const char *kStreams[20] =
+{
+  "H264", "AC3", "MPEG2AUDIO", "MPEG2AUDIO", "EAC3", "AAC", "AAC_LATM",
+  "MPEG2AUDIO", "AC3", "MPEG2AUDIO", "MPEG2AUDIO", "AC3", "MPEG2AUDIO",
+  "DVBSUB", "DVBSUB", "DVBSUB", "DVBSUB", "TELETEXT", "TELETEXT", "DVBSUB"
+};
+
+const int kThreads = 8;
+const int kChanges = 200000;
+
+std::vector<std::string> g_table;
+std::atomic<int> g_lookups(0);
+
+int Search(const char *name)
+{
+  g_lookups++;
+  for (size_t i = 0; i < g_table.size(); i++)
+  {
+    if (g_table[i] == name)
+      return (int)i;
+  }
+  return -1;
+}
+
+int Distinct()
+{
+  int count = 0;
+  for (int i = 0; i < 20; i++)
+  {
+    int j = 0;
+    while (j < i && strcmp(kStreams[i], kStreams[j]) != 0)
+      j++;
+    if (j == i)
+      count++;
+  }
+  return count;
+}
+
+}
+
+int main()
+{
+  // the names we look for spread over the table, the rest made up
+  const char *known[] = { "H264", "AC3", "MPEG2AUDIO", "EAC3", "AAC", "AAC_LATM", "DVBSUB", "TELETEXT" };
+  for (int i = 0; i < 500; i++)
+    g_table.push_back("codec" + std::to_string(i));
+  for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++)
+    g_table[60 * (i + 1)] = known[i];
+
+  cNameCache<int> cache;
+  std::atomic<int> wrong(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++)
+  {
+    threads.push_back(std::thread([&cache, &wrong]() {
+      for (int n = 0; n < 10000; n++)
+      {
+        const char *name = kStreams[n % 20];
+        int expected = -1;
+        for (size_t i = 0; i < g_table.size() && expected < 0; i++)
+          expected = g_table[i] == name ? (int)i : -1;
+        if (cache.Get(name, Search) != expected)
+          wrong++;
+      }
+    }));
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  bool ok = wrong == 0 && g_lookups == Distinct() && cache.Size() == (size_t)Distinct();
+  printf("%d threads: %d wrong values, %d lookups for %d names\n", kThreads, (int)wrong, (int)g_lookups, Distinct());
+
+  long long sum = 0;
+  Clock::time_point start = Clock::now();
+  for (int c = 0; c < kChanges; c++)
+  {
+    for (int i = 0; i < 20; i++)
+      sum += Search(kStreams[i]);
+  }
+  double uncached = kChanges / std::chrono::duration<double>(Clock::now() - start).count();
+
+  start = Clock::now();
+  for (int c = 0; c < kChanges; c++)
+  {
+    for (int i = 0; i < 20; i++)
+      sum += cache.Get(kStreams[i], Search);
+  }
+  double cached = kChanges / std::chrono::duration<double>(Clock::now() - start).count();
+
+  printf("20 streams: uncached %.0f k stream changes/s, cached %.0f k stream changes/s (%lld)\n",
+         uncached / 1e3, cached / 1e3, sum);
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+/*
+ * VNSI_GETTIME round trips against a local mock server, with the receive
+ * loop cVNSIData::Process() used to run (ReadMessage(5) then Sleep(5) when
+ * nothing arrived) and the one it runs now (block in poll on the socket and
+ * the wakeup). Also counts how often each loop wakes up while idle.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "VNSISocket.h"
+#include "vnsicommand.h"
+#include "p8-platform/threads/mutex.h"
+
+namespace
+{
+
+const int kRequests = 500;
+const int kIdleTime = 1000;       // ms
+
+typedef std::chrono::steady_clock Clock;
+
+bool RecvAll(int fd, void *data, size_t len)
+{
+  uint8_t *p = (uint8_t*)data;
+  while (len > 0)
+  {
+    ssize_t ret = recv(fd, p, len, 0);
+    if (ret <= 0)
+      return false;
+    p += ret;
+    len -= ret;
+  }
+  return true;
+}
+
+// answers every request with the server time, like VDR's VNSI plugin
+void MockServer(int listener)
+{
+  int fd = accept(listener, nullptr, nullptr);
+  if (fd < 0)
+    return;
+
+  uint32_t request[4];  // channel, serial, opcode, length
+  while (RecvAll(fd, request, sizeof(request)))
+  {
+    uint32_t reply[5];
+    reply[0] = htonl(VNSI_CHANNEL_REQUEST_RESPONSE);
+    reply[1] = request[1];
+    reply[2] = htonl(8);
+    reply[3] = htonl((uint32_t)time(nullptr));
+    reply[4] = htonl(0);
+    if (send(fd, reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply))
+      break;
+  }
+  close(fd);
+}
+
+struct SReceiver
+{
+  cVNSISocket *socket;
+  cVNSIWakeup wakeup;
+  bool polling;
+  std::atomic<bool> stop{false};
+  std::atomic<uint32_t> lastSerial{0};
+  std::atomic<int> wakeups{0};
+  P8PLATFORM::CEvent replied;
+};
+
+void Receive(SReceiver &receiver)
+{
+  while (!receiver.stop)
+  {
+    uint32_t channel;
+    ssize_t ret;
+    if (receiver.polling)
+      ret = receiver.socket->Read(&channel, sizeof(channel), 5);
+    else
+      ret = receiver.socket->Read(&channel, sizeof(channel), 1000, &receiver.wakeup);
+
+    if (ret < 0)
+      break;
+    if (ret == 0)
+    {
+      receiver.wakeups++;
+      if (receiver.polling)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      continue;
+    }
+
+    uint32_t rest[4];
+    if (receiver.socket->Read((uint8_t*)&channel + ret, sizeof(channel) - ret, 10000) < 0 ||
+        receiver.socket->Read(rest, sizeof(rest), 10000) != sizeof(rest))
+      break;
+
+    receiver.lastSerial = ntohl(rest[0]);
+    receiver.replied.Signal();
+  }
+}
+
+bool Run(int port, bool polling)
+{
+  cVNSISocket socket("127.0.0.1", port);
+  if (!socket.Open(1000))
+  {
+    printf("connect failed\n");
+    return false;
+  }
+
+  SReceiver receiver;
+  receiver.socket = &socket;
+  receiver.polling = polling;
+  std::thread thread(Receive, std::ref(receiver));
+
+  // requests come at arbitrary times relative to the receive loop
+  std::mt19937 random(42);
+  std::uniform_int_distribution<int> gap(0, 5000);
+  std::vector<double> times;
+  bool ok = true;
+
+  for (uint32_t serial = 1; serial <= kRequests && ok; serial++)
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(gap(random)));
+
+    uint32_t request[4];
+    request[0] = htonl(VNSI_CHANNEL_REQUEST_RESPONSE);
+    request[1] = htonl(serial);
+    request[2] = htonl(VNSI_GETTIME);
+    request[3] = htonl(0);
+
+    Clock::time_point start = Clock::now();
+    cVNSISocket::Buffer buffer = { request, sizeof(request) };
+    ok = socket.Write(&buffer, 1);
+    while (ok && receiver.lastSerial != serial)
+      ok = receiver.replied.Wait(10000);
+    times.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+  }
+
+  receiver.wakeups = 0;
+  std::this_thread::sleep_for(std::chrono::milliseconds(kIdleTime));
+  int wakeups = receiver.wakeups;
+
+  receiver.stop = true;
+  receiver.wakeup.Signal();
+  thread.join();
+  socket.Close();
+
+  if (!ok)
+  {
+    printf("%s: request failed\n", polling ? "sleep polling" : "blocking poll");
+    return false;
+  }
+
+  std::sort(times.begin(), times.end());
+  double sum = 0;
+  for (double t : times)
+    sum += t;
+  printf("%-14s round trip mean %7.1f us, median %7.1f us, p99 %7.1f us, %d idle wakeups/s\n",
+         polling ? "sleep polling:" : "blocking poll:", sum / times.size(),
+         times[times.size() / 2], times[times.size() * 99 / 100], wakeups * 1000 / kIdleTime);
+  return true;
+}
+
+int Listen(int &port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(fd, 1) < 0 || getsockname(fd, (struct sockaddr*)&addr, &len) < 0)
+    return -1;
+  port = ntohs(addr.sin_port);
+  return fd;
+}
+
+}
+
+int main()
+{
+  for (int polling = 1; polling >= 0; polling--)
+  {
+    int port;
+    int listener = Listen(port);
+    if (listener < 0)
+    {
+      perror("listen");
+      return 1;
+    }
+
+    std::thread server(MockServer, listener);
+    bool ok = Run(port, polling != 0);
+    server.join();
+    close(listener);
+    if (!ok)
+      return 1;
+  }
+  return 0;
+}
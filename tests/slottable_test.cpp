@@ -0,0 +1,166 @@
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+/*
+ * Many requester threads against one receiver thread, like ReadResult()
+ * callers against cVNSIData::Process(). The receiver stands in for the
+ * server: it answers most requests, some late and some never, so claims,
+ * hand-overs, cancels and waits for a free slot all race each other.
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "slottable.h"
+
+namespace
+{
+
+struct SWire
+{
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<uint32_t> serials;
+  bool done = false;
+};
+
+const int kThreads = 96;          // more than cSlotTable::kSlots
+const int kRequests = 2000;       // per thread
+const int kTimeout = 50;          // ms a requester waits for its reply
+
+std::atomic<uint32_t> g_serial(1);
+std::atomic<int> g_answered(0);
+std::atomic<int> g_timedOut(0);
+std::atomic<int> g_noSlot(0);
+std::atomic<int> g_wrong(0);
+
+void Requester(cSlotTable<uint32_t> &table, SWire &wire)
+{
+  for (int i = 0; i < kRequests; i++)
+  {
+    uint32_t serial = g_serial++;
+    cSlotTable<uint32_t>::SSlot *slot = table.Enqueue(serial, 1000);
+    if (!slot)
+    {
+      g_noSlot++;
+      continue;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(wire.mutex);
+      wire.serials.push_back(serial);
+    }
+    wire.cond.notify_one();
+
+    slot->event.Wait(kTimeout);
+    std::unique_ptr<uint32_t> value = table.Dequeue(slot);
+    if (!value)
+      g_timedOut++;
+    else if (*value != serial)
+      g_wrong++;
+    else
+      g_answered++;
+  }
+}
+
+void Receiver(cSlotTable<uint32_t> &table, SWire &wire)
+{
+  unsigned int count = 0;
+  std::deque<uint32_t> late;
+
+  for (;;)
+  {
+    uint32_t serial;
+    {
+      std::unique_lock<std::mutex> lock(wire.mutex);
+      wire.cond.wait(lock, [&wire] { return wire.done || !wire.serials.empty(); });
+      if (wire.serials.empty())
+        break;
+      serial = wire.serials.front();
+      wire.serials.pop_front();
+    }
+
+    // every 97th request is never answered, every 31st only after a few
+    // more, possibly once its requester gave up
+    count++;
+    if (count % 97 == 0)
+      continue;
+    if (count % 31 == 0)
+    {
+      late.push_back(serial);
+      continue;
+    }
+
+    table.Set(serial, std::unique_ptr<uint32_t>(new uint32_t(serial)));
+    if (late.size() > 8)
+    {
+      uint32_t old = late.front();
+      late.pop_front();
+      table.Set(old, std::unique_ptr<uint32_t>(new uint32_t(old)));
+    }
+  }
+}
+
+}
+
+int main()
+{
+  cSlotTable<uint32_t> table;
+  SWire wire;
+
+  std::thread receiver(Receiver, std::ref(table), std::ref(wire));
+  std::vector<std::thread> requesters;
+  for (int i = 0; i < kThreads; i++)
+    requesters.push_back(std::thread(Requester, std::ref(table), std::ref(wire)));
+
+  for (auto &thread : requesters)
+    thread.join();
+
+  {
+    std::lock_guard<std::mutex> lock(wire.mutex);
+    wire.done = true;
+  }
+  wire.cond.notify_one();
+  receiver.join();
+
+  int total = kThreads * kRequests;
+  printf("%d requests: %d answered, %d timed out, %d without slot, %d wrong\n",
+         total, (int)g_answered, (int)g_timedOut, (int)g_noSlot, (int)g_wrong);
+
+  // every request is accounted for exactly once, and no reply ever went
+  // to a request it was not meant for
+  bool ok = g_wrong == 0 && g_answered + g_timedOut + g_noSlot == total && g_answered > total / 2;
+
+  // all slots are free again
+  for (size_t i = 0; ok && i < cSlotTable<uint32_t>::kSlots; i++)
+  {
+    cSlotTable<uint32_t>::SSlot *slot = table.Enqueue(0x80000000 + i);
+    if (!slot)
+      ok = false;
+  }
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+/*
+ *      Copyright (C) 2010 Alwin Esch (Team XBMC)
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+/*
+ * cStreamIndex against the linear search it replaced in cVNSIDemux::Read:
+ * the same answers for random stream setups, and lookups per second on a
+ * synthetic mux, one video, several audio and subtitle streams, with the
+ * packet mix of a DVB channel (mostly video).
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "streamindex.h"
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+const int kPackets = 20000000;
+
+int LinearFind(const std::vector<uint32_t> &pids, uint32_t pid)
+{
+  for (size_t i = 0; i < pids.size(); i++)
+  {
+    if (pids[i] == pid)
+      return i <= (size_t)cStreamIndex::kMaxIndex ? (int)i : -1;
+  }
+  return -1;
+}
+
+bool Check(std::mt19937 &random)
+{
+  std::uniform_int_distribution<int> count(0, 200);
+  std::uniform_int_distribution<uint32_t> pid(0, 0x2100);   // some beyond 13 bit
+
+  std::vector<uint32_t> pids(count(random));
+  for (auto &p : pids)
+    p = pid(random);
+
+  cStreamIndex index;
+  for (size_t i = 0; i < pids.size(); i++)
+    index.Add(pids[i], i);
+
+  for (uint32_t p = 0; p < 0x2100; p++)
+  {
+    int expected = cStreamIndex::Covers(p) ? LinearFind(pids, p) : -1;
+    if (index.Find(p) != expected)
+    {
+      printf("pid %u: index %d, expected %d\n", p, index.Find(p), expected);
+      return false;
+    }
+  }
+
+  // a rebuild forgets the old setup
+  index.Clear();
+  for (auto p : pids)
+  {
+    if (index.Find(p) != -1)
+      return false;
+  }
+  return true;
+}
+
+template<typename F>
+double Rate(const std::vector<uint32_t> &packets, F find, long long &sum)
+{
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < kPackets; i++)
+    sum += find(packets[i % packets.size()]);
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  return kPackets / seconds;
+}
+
+}
+
+int main()
+{
+  std::mt19937 random(42);
+  for (int i = 0; i < 1000; i++)
+  {
+    if (!Check(random))
+    {
+      printf("FAILED\n");
+      return 1;
+    }
+  }
+
+  // 1 video, 12 audio, 7 subtitle streams. Video pid last, the worst case
+  // for the search, as with many audio tracks announced first
+  std::vector<uint32_t> pids;
+  for (uint32_t i = 0; i < 12; i++)
+    pids.push_back(0x100 + i);
+  for (uint32_t i = 0; i < 7; i++)
+    pids.push_back(0x200 + i);
+  pids.push_back(0x1ff);
+
+  cStreamIndex index;
+  for (size_t i = 0; i < pids.size(); i++)
+    index.Add(pids[i], i);
+
+  // about 85% video, 13% audio, 2% subtitles
+  std::discrete_distribution<int> kind({85, 13, 2});
+  std::vector<uint32_t> packets(65536);
+  for (auto &p : packets)
+  {
+    switch (kind(random))
+    {
+    case 0: p = 0x1ff; break;
+    case 1: p = 0x100 + random() % 12; break;
+    default: p = 0x200 + random() % 7; break;
+    }
+  }
+
+  long long sum = 0;
+  double linear = Rate(packets, [&pids](uint32_t p) { return LinearFind(pids, p); }, sum);
+  double table = Rate(packets, [&index](uint32_t p) { return index.Find(p); }, sum);
+
+  printf("20 streams: linear search %.0f M lookups/s, index %.0f M lookups/s (%lld)\n",
+         linear / 1e6, table / 1e6, sum);
+  printf("OK\n");
+  return 0;
+}